@@ -24,12 +24,15 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
+#include <cctype>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <boost/asio.hpp>
 
 #include "beast_input.h"
 #include "modes_message.h"
+#include "cpu_dispatch.h"
 
 using namespace beast;
 
@@ -38,7 +41,9 @@ enum class BeastInput::ParserState { RESYNC, READ_1A, READ_TYPE, READ_DATA, READ
 BeastInput::BeastInput(boost::asio::io_service &service_,
                        const Settings &fixed_settings_,
                        const modes::Filter &filter_)
-    : receiver_type(ReceiverType::UNKNOWN),
+    : assumed_receiver_type(ReceiverType::UNKNOWN),
+      assumed_gps_timestamps(false),
+      receiver_type(ReceiverType::UNKNOWN),
       fixed_settings(fixed_settings_),
       filter(filter_),
       receiving_gps_timestamps(false),
@@ -49,6 +54,7 @@ BeastInput::BeastInput(boost::asio::io_service &service_,
       good_messages_count(0),
       bad_bytes_count(0),
       first_message(true),
+      suspended(false),
       state(ParserState::RESYNC)
 {
 }
@@ -69,7 +75,7 @@ void BeastInput::connection_established()
     auto self(shared_from_this());
 
     first_message = true;
-    receiving_gps_timestamps = false;
+    receiving_gps_timestamps = assumed_gps_timestamps;
     good_sync = false;
     good_messages_count = 0;
     bad_bytes_count = 0;
@@ -80,13 +86,20 @@ void BeastInput::connection_established()
         receiver_type = ReceiverType::RADARCAPE;
     else if (fixed_settings.radarcape.off())
         receiver_type = ReceiverType::BEAST;
-    else {
-        receiver_type = ReceiverType::UNKNOWN;
+    else if (assumed_receiver_type == ReceiverType::BEAST) {
+        // a status message will still switch us to radarcape mode
+        receiver_type = ReceiverType::BEAST;
+    } else {
+        // if we are assuming a radarcape, this is only a check that it
+        // is still sending status messages
+        receiver_type = assumed_receiver_type;
         autodetect_timer.expires_from_now(radarcape_detect_interval);
         autodetect_timer.async_wait([this,self] (const boost::system::error_code &ec) {
                 if (!ec) {
                     receiver_type = ReceiverType::BEAST;
+                    receiving_gps_timestamps = false;
                     send_settings_message();
+                    state_learned();
                 }
             });
     }
@@ -134,11 +147,210 @@ void BeastInput::set_filter(const modes::Filter &newfilter)
     }
 }
 
+void BeastInput::set_fixed_settings(const Settings &newsettings)
+{
+    fixed_settings = newsettings;
+
+    // a forced radarcape setting overrides autodetection immediately;
+    // clearing it leaves the current receiver type until the next reconnect
+    if (fixed_settings.radarcape.on() && receiver_type != ReceiverType::RADARCAPE) {
+        autodetect_timer.cancel();
+        receiver_type = ReceiverType::RADARCAPE;
+    } else if (fixed_settings.radarcape.off() && receiver_type != ReceiverType::BEAST) {
+        autodetect_timer.cancel();
+        receiver_type = ReceiverType::BEAST;
+    }
+
+    send_settings_message();
+}
+
+std::string BeastInput::learned_state() const
+{
+    std::ostringstream os;
+    os << static_cast<int>(assumed_receiver_type) << ' ' << (assumed_gps_timestamps ? 1 : 0);
+    save_connection_state(os);
+    return os.str();
+}
+
+void BeastInput::restore_state(const std::string &saved)
+{
+    std::istringstream is(saved);
+    int saved_receiver, saved_gps;
+    if (!(is >> saved_receiver >> saved_gps))
+        return;
+
+    if (saved_receiver == static_cast<int>(ReceiverType::BEAST) || saved_receiver == static_cast<int>(ReceiverType::RADARCAPE)) {
+        assumed_receiver_type = static_cast<ReceiverType>(saved_receiver);
+        assumed_gps_timestamps = (assumed_receiver_type == ReceiverType::RADARCAPE && saved_gps != 0);
+    }
+
+    restore_connection_state(is);
+}
+
+void BeastInput::state_learned()
+{
+    if (receiver_type != ReceiverType::UNKNOWN) {
+        assumed_receiver_type = receiver_type;
+        assumed_gps_timestamps = receiving_gps_timestamps;
+    }
+
+    if (state_notifier)
+        state_notifier();
+}
+
+void BeastInput::suspend()
+{
+    suspended = true;
+    autodetect_timer.cancel();
+    reconnect_timer.cancel();
+    liveness_timer.cancel();
+    suspend_reading();
+}
+
+void BeastInput::start_liveness_timer()
+{
+    auto self(shared_from_this());
+    liveness_timer.expires_from_now(radarcape_liveness_interval);
+    liveness_timer.async_wait([this,self] (const boost::system::error_code &ec) {
+            if (!ec) {
+                std::cerr << what() << ": no recent status messages received" << std::endl;
+                disconnect();
+                connection_failed();
+            }
+        });
+}
+
+void BeastInput::resume()
+{
+    if (!suspended)
+        return;
+
+    suspended = false;
+    if (native_handle() < 0) {
+        // suspend() cancelled the pending reconnect
+        connection_failed();
+        return;
+    }
+
+    // suspend() cancelled the timers. Detection that was still under way
+    // starts over; a radarcape that has stopped sending status messages is
+    // caught by the liveness check.
+    if (!is_connected())
+        connection_established();
+    else if (receiver_type == ReceiverType::RADARCAPE)
+        start_liveness_timer();
+    resume_reading();
+}
+
+// partially read frames are saved as hex, "-" if empty
+static void write_bytes(std::ostream &os, const helpers::bytebuf &buf)
+{
+    if (buf.empty()) {
+        os << '-';
+        return;
+    }
+
+    std::ostringstream hex;
+    hex << std::hex << std::setfill('0');
+    for (auto b : buf)
+        hex << std::setw(2) << (int)b;
+    os << hex.str();
+}
+
+static bool read_bytes(std::istream &is, helpers::bytebuf &buf)
+{
+    std::string hex;
+    if (!(is >> hex))
+        return false;
+
+    buf.clear();
+    if (hex == "-")
+        return true;
+    if (hex.size() % 2 != 0)
+        return false;
+
+    for (std::size_t i = 0; i < hex.size(); i += 2) {
+        if (!std::isxdigit(hex[i]) || !std::isxdigit(hex[i+1]))
+            return false;
+        buf.push_back(std::stoul(hex.substr(i, 2), nullptr, 16));
+    }
+    return true;
+}
+
+std::string BeastInput::handoff_state() const
+{
+    std::ostringstream os;
+    os << what()
+       << ' ' << static_cast<int>(receiver_type)
+       << ' ' << (receiving_gps_timestamps ? 1 : 0)
+       << ' ' << static_cast<int>(state)
+       << ' ' << static_cast<int>(messagetype)
+       << ' ';
+    write_bytes(os, metadata);
+    os << ' ';
+    write_bytes(os, messagedata);
+    save_connection_state(os);
+    return os.str();
+}
+
+bool BeastInput::adopt(int fd, const std::string &saved)
+{
+    std::istringstream is(saved);
+
+    std::string saved_what;
+    if (!(is >> saved_what) || saved_what != what())
+        return false;
+
+    int saved_receiver, saved_gps, saved_state, saved_type;
+    helpers::bytebuf saved_metadata, saved_messagedata;
+    if (!(is >> saved_receiver >> saved_gps >> saved_state >> saved_type) ||
+        !read_bytes(is, saved_metadata) ||
+        !read_bytes(is, saved_messagedata))
+        return false;
+
+    // only connections that were synced to a known receiver are handed over
+    if (saved_receiver != static_cast<int>(ReceiverType::BEAST) && saved_receiver != static_cast<int>(ReceiverType::RADARCAPE))
+        return false;
+    if (saved_state < static_cast<int>(ParserState::RESYNC) || saved_state > static_cast<int>(ParserState::READ_ESCAPED_1A))
+        return false;
+    if (saved_type < static_cast<int>(modes::MessageType::INVALID) || saved_type > static_cast<int>(modes::MessageType::POSITION))
+        return false;
+    if (saved_metadata.size() > 7 || saved_messagedata.size() > modes::message_size(static_cast<modes::MessageType>(saved_type)))
+        return false;
+
+    if (!adopt_connection(fd, is))
+        return false;
+
+    // Only now take on the saved state, so that a failed adoption leaves
+    // the parser as it was for start(). Nothing has been read from the
+    // connection yet; that happens once this returns to the io_service.
+    receiver_type = static_cast<ReceiverType>(saved_receiver);
+    receiving_gps_timestamps = (saved_gps != 0);
+    state = static_cast<ParserState>(saved_state);
+    messagetype = static_cast<modes::MessageType>(saved_type);
+    metadata = std::move(saved_metadata);
+    messagedata = std::move(saved_messagedata);
+    good_sync = true;
+    good_messages_count = 0;
+    bad_bytes_count = 0;
+    first_message = true;
+
+    send_settings_message();
+    return true;
+}
+
 void BeastInput::parse_input(const helpers::bytebuf &buf)
 {
     auto p = buf.begin();
     auto last_good_message_end = p;
 
+    // one clock read covers every message in this buffer
+    read_time = std::chrono::steady_clock::now();
+
+    // where the next 0x1A at or after p is, once READ_DATA has looked
+    auto next_escape = buf.begin();
+    bool next_escape_known = false;
+
     while (p != buf.end()) {
         switch (state) {
         case ParserState::RESYNC:
@@ -194,6 +406,24 @@ void BeastInput::parse_input(const helpers::bytebuf &buf)
                 // Reading message contents
                 std::size_t msglen = modes::message_size(messagetype);
                 while (p != buf.end() && messagedata.size() < msglen) {
+                    // Copy everything up to the next 0x1A in one go. That
+                    // is usually the start of the next message, so one
+                    // search covers a whole message.
+                    if (!next_escape_known || next_escape < p) {
+                        next_escape = p + helpers::kernels.find_escape(&*p, buf.end() - p);
+                        next_escape_known = true;
+                    }
+
+                    std::size_t wanted = (7 - metadata.size()) + (msglen - messagedata.size());
+                    std::size_t run = std::min<std::size_t>(wanted, next_escape - p);
+                    if (run > 0) {
+                        std::size_t meta = std::min<std::size_t>(run, 7 - metadata.size());
+                        metadata.insert(metadata.end(), p, p + meta);
+                        messagedata.insert(messagedata.end(), p + meta, p + run);
+                        p += run;
+                        continue;
+                    }
+
                     uint8_t b = *p++;
                     if (b == 0x1A) {
                         if (p == buf.end()) {
@@ -294,22 +524,18 @@ void BeastInput::dispatch_message()
     // monitor status messages for GPS timestamp bit
     // and for radarcape autodetection
     if (messagetype == modes::MessageType::STATUS) {
-        receiving_gps_timestamps = Settings(messagedata[0]).gps_timestamps.on();
+        bool gps = Settings(messagedata[0]).gps_timestamps.on();
+        bool learned = (gps != receiving_gps_timestamps || receiver_type != ReceiverType::RADARCAPE);
+        receiving_gps_timestamps = gps;
         if (receiver_type != ReceiverType::RADARCAPE) {
             receiver_type = ReceiverType::RADARCAPE;
-            autodetect_timer.cancel();
             send_settings_message(); // for the g/G setting
         }
+        autodetect_timer.cancel();
+        if (learned)
+            state_learned();
 
-        auto self(shared_from_this());
-        liveness_timer.expires_from_now(radarcape_liveness_interval);
-        liveness_timer.async_wait([this,self] (const boost::system::error_code &ec) {
-                if (!ec) {
-                    std::cerr << what() << ": no recent status messages received" << std::endl;
-                    disconnect();
-                    connection_failed();
-                }
-            });
+        start_liveness_timer();
     }
 
     if (!can_dispatch())
@@ -349,6 +575,7 @@ void BeastInput::dispatch_message()
                                     receiving_gps_timestamps ? modes::TimestampType::GPS : modes::TimestampType::TWELVEMEG,
                                     timestamp,
                                     signal,
-                                    std::move(messagedata)));
+                                    std::move(messagedata),
+                                    read_time));
     messagedata.clear(); // make sure we leave it in a valid state after moving
 }
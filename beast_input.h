@@ -32,6 +32,9 @@
 #include <vector>
 #include <chrono>
 #include <memory>
+#include <functional>
+#include <iosfwd>
+#include <string>
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/serial_port.hpp>
@@ -89,6 +92,44 @@ namespace beast {
         // change the input filter to the given filter
         void set_filter(const modes::Filter &filter_);
 
+        // change the settings that are forced regardless of the filter
+        void set_fixed_settings(const Settings &fixed_settings_);
+
+        const Settings &get_fixed_settings(void) const {
+            return fixed_settings;
+        }
+
+        // Handing the connection to a replacement process: suspend() stops
+        // reading, handoff_state() then describes the receiver and parser
+        // state, and native_handle() is the descriptor to pass on (-1 if
+        // there is no open connection). If the handoff fails, resume()
+        // carries on where suspend() left off.
+        void suspend(void);
+        void resume(void);
+        std::string handoff_state(void) const;
+        virtual int native_handle(void) = 0;
+
+        // What has been learned about the receiver that is worth keeping
+        // across restarts: its type, whether it sends GPS timestamps and,
+        // for serial ports, the baud rate. The notifier is called whenever
+        // detection settles on something.
+        std::string state_key(void) const { return what(); }
+        std::string learned_state(void) const;
+        void set_state_notifier(std::function<void()> notifier) {
+            state_notifier = notifier;
+        }
+
+        // Start from a previously learned state rather than detecting from
+        // scratch, so data flows as soon as the connection is up. Detection
+        // still runs and corrects it if the receiver has changed. Call
+        // before start().
+        void restore_state(const std::string &state);
+
+        // Carry on with a connection handed over by a previous process,
+        // instead of calling start(). Returns false, leaving fd alone, if
+        // the state belongs to a different input.
+        bool adopt(int fd, const std::string &state);
+
         // change where received messages go to
         void set_message_notifier(MessageNotifier notifier) {
             message_notifier = notifier;
@@ -117,14 +158,34 @@ namespace beast {
         virtual void disconnect() = 0;
         virtual bool low_level_write(std::shared_ptr<helpers::bytebuf> message) = 0;
 
+        // handoff support, see suspend() and adopt()
+        bool is_suspended() const { return suspended; }
+        virtual void suspend_reading() = 0;
+        virtual void resume_reading() = 0;
+        virtual void save_connection_state(std::ostream &os) const {}
+        virtual bool adopt_connection(int fd, std::istream &is) = 0;
+
+        // see learned_state() and restore_state()
+        void state_learned(void);
+        virtual void restore_connection_state(std::istream &is) {}
+
     private:
         void send_settings_message(void);
+        void start_liveness_timer(void);
         void lost_sync(void);
         void dispatch_message(void);
 
         // handler to call with deframed messages
         MessageNotifier message_notifier;
 
+        // handler to call when learned_state() may have changed
+        std::function<void()> state_notifier;
+
+        // receiver type and GPS timestamp mode to assume on connecting,
+        // from restore_state() or the last detection
+        ReceiverType assumed_receiver_type;
+        bool assumed_gps_timestamps;
+
         // the currently detected receiver type
         ReceiverType receiver_type;
 
@@ -158,6 +219,12 @@ namespace beast {
         // are we still waiting for the first good message?
         bool first_message;
 
+        // have we stopped reading to hand off to another process?
+        bool suspended;
+
+        // host time of the read currently being parsed
+        std::chrono::steady_clock::time_point read_time;
+
         // deframed message (possibly still being built)
         modes::MessageType messagetype;
         helpers::bytebuf metadata;
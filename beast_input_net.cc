@@ -27,6 +27,8 @@
 #include <iomanip>
 #include <iostream>
 
+#include <sys/socket.h>
+
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio/ip/v6_only.hpp>
@@ -134,6 +136,41 @@ bool NetInput::low_level_write(std::shared_ptr<helpers::bytebuf> message)
     return true;
 }
 
+int NetInput::native_handle()
+{
+    return socket.is_open() ? socket.native_handle() : -1;
+}
+
+void NetInput::suspend_reading()
+{
+    if (socket.is_open()) {
+        boost::system::error_code ignored;
+        socket.cancel(ignored);
+    }
+}
+
+void NetInput::resume_reading()
+{
+    start_reading();
+}
+
+bool NetInput::adopt_connection(int fd, std::istream &is)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    if (::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addrlen) < 0)
+        return false;
+
+    boost::system::error_code ec;
+    socket.assign(addr.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), fd, ec);
+    if (ec)
+        return false;
+
+    std::cerr << what() << ": took over connection to " << socket.remote_endpoint(ec) << std::endl;
+    start_reading();
+    return true;
+}
+
 void NetInput::handle_error(const boost::system::error_code &ec)
 {
     if (ec == boost::asio::error::operation_aborted)
@@ -165,6 +202,9 @@ void NetInput::start_reading(const boost::system::error_code &ec)
         return;
     }
 
+    if (is_suspended())
+        return;
+
     auto self(std::static_pointer_cast<NetInput>(shared_from_this()));
     std::shared_ptr<helpers::bytebuf> buf;
 
@@ -176,17 +216,17 @@ void NetInput::start_reading(const boost::system::error_code &ec)
     }
 
     socket.async_read_some(boost::asio::buffer(*buf),
-                           [this,self,buf] (const boost::system::error_code &ec, std::size_t len) {
-                               if (ec) {
-                                   readbuf = buf;
-                                   handle_error(ec);
-                               } else {
-                                   buf->resize(len);
-                                   parse_input(*buf);
-                                   check_framing_errors();
-                                   readbuf = buf;
-
-                                   start_reading();
-                               }
-                           });
+                           helpers::recycle(read_memory, [this,self,buf] (const boost::system::error_code &ec, std::size_t len) {
+                                   if (ec) {
+                                       readbuf = buf;
+                                       handle_error(ec);
+                                   } else {
+                                       buf->resize(len);
+                                       parse_input(*buf);
+                                       check_framing_errors();
+                                       readbuf = buf;
+
+                                       start_reading();
+                                   }
+                               }));
 }
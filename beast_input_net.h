@@ -31,6 +31,7 @@
 #include <boost/asio/ip/tcp.hpp>
 
 #include "beast_input.h"
+#include "handler_memory.h"
 
 namespace beast {
     class NetInput : public BeastInput {
@@ -58,6 +59,10 @@ namespace beast {
         void try_to_connect(void) override;
         void disconnect(void) override;
         bool low_level_write(std::shared_ptr<helpers::bytebuf> message) override;
+        int native_handle(void) override;
+        void suspend_reading(void) override;
+        void resume_reading(void) override;
+        bool adopt_connection(int fd, std::istream &is) override;
 
     private:
         // construct a new net input instance, don't start yet
@@ -85,6 +90,9 @@ namespace beast {
         // cached buffer used for reads
         std::shared_ptr<helpers::bytebuf> readbuf;
 
+        // recycled handler memory for the read loop
+        helpers::HandlerMemory read_memory;
+
         // have we warned about a possibly bad protocol?
         bool warned_about_framing;
     };
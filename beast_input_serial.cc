@@ -132,6 +132,70 @@ bool SerialInput::low_level_write(std::shared_ptr<helpers::bytebuf> message)
     return true;
 }
 
+int SerialInput::native_handle()
+{
+    return port.is_open() ? port.native_handle() : -1;
+}
+
+void SerialInput::suspend_reading()
+{
+    autobaud_timer.cancel();
+    read_timer.cancel();
+    if (port.is_open()) {
+        boost::system::error_code ignored;
+        port.cancel(ignored);
+    }
+}
+
+void SerialInput::resume_reading()
+{
+    // suspend_reading() cancelled the autobaud timer; reopening at the
+    // current rate restarts it
+    if (autobauding)
+        try_to_connect();
+    else
+        start_reading();
+}
+
+void SerialInput::save_connection_state(std::ostream &os) const
+{
+    os << ' ' << baud_rate;
+}
+
+void SerialInput::restore_connection_state(std::istream &is)
+{
+    unsigned int saved_rate;
+    if (!(is >> saved_rate) || saved_rate == 0 || autobaud_rates.empty())
+        return;
+
+    // try the rate that worked last time first; autobauding still
+    // confirms it, which only takes a few messages
+    autobaud_rates.erase(std::remove(autobaud_rates.begin(), autobaud_rates.end(), saved_rate), autobaud_rates.end());
+    autobaud_rates.insert(autobaud_rates.begin(), saved_rate);
+    autobaud_rate = autobaud_rates.begin();
+    baud_rate = saved_rate;
+}
+
+bool SerialInput::adopt_connection(int fd, std::istream &is)
+{
+    unsigned int saved_rate;
+    if (!(is >> saved_rate) || saved_rate == 0)
+        return false;
+
+    boost::system::error_code ec;
+    port.assign(fd, ec);
+    if (ec)
+        return false;
+
+    // the previous process already settled on a rate that works
+    baud_rate = saved_rate;
+    autobauding = false;
+
+    std::cerr << what() << ": took over port at " << baud_rate << "bps" << std::endl;
+    start_reading();
+    return true;
+}
+
 void SerialInput::handle_error(const boost::system::error_code &ec)
 {
     if (ec == boost::asio::error::operation_aborted)
@@ -197,6 +261,9 @@ void SerialInput::start_reading(const boost::system::error_code &ec)
         return;
     }
 
+    if (is_suspended())
+        return;
+
     auto self(std::static_pointer_cast<SerialInput>(shared_from_this()));
     std::shared_ptr<helpers::bytebuf> buf;
 
@@ -209,29 +276,29 @@ void SerialInput::start_reading(const boost::system::error_code &ec)
 
     read_timer.expires_from_now(read_interval);
     port.async_read_some(boost::asio::buffer(*buf),
-                         [this,self,buf] (const boost::system::error_code &ec, std::size_t len) {
-                             if (ec) {
-                                 readbuf = buf;
-                                 handle_error(ec);
-                             } else {
-                                 buf->resize(len);
-                                 parse_input(*buf);
-                                 check_framing_errors();
-                                 readbuf = buf;
-
-                                 // If we didn't get a full-ish buffer, then wait a bit before the next read so we don't
-                                 // spin reading only a few bytes each time.
-
-                                 // (unfortunately, boost::asio's edge-triggered epoll still gets woken repeatedly each time a
-                                 // little more data arrives, but at least we don't have to do a bunch of work on every one of
-                                 // those)
-                                 if (len < read_buffer_size*3/4) {
-                                     read_timer.async_wait(std::bind(&SerialInput::start_reading, self, std::placeholders::_1));
+                         helpers::recycle(read_memory, [this,self,buf] (const boost::system::error_code &ec, std::size_t len) {
+                                 if (ec) {
+                                     readbuf = buf;
+                                     handle_error(ec);
                                  } else {
-                                     start_reading();
+                                     buf->resize(len);
+                                     parse_input(*buf);
+                                     check_framing_errors();
+                                     readbuf = buf;
+
+                                     // If we didn't get a full-ish buffer, then wait a bit before the next read so we don't
+                                     // spin reading only a few bytes each time.
+
+                                     // (unfortunately, boost::asio's edge-triggered epoll still gets woken repeatedly each time a
+                                     // little more data arrives, but at least we don't have to do a bunch of work on every one of
+                                     // those)
+                                     if (len < read_buffer_size*3/4) {
+                                         read_timer.async_wait(helpers::recycle(timer_memory, std::bind(&SerialInput::start_reading, self, std::placeholders::_1)));
+                                     } else {
+                                         start_reading();
+                                     }
                                  }
-                             }
-                         });
+                             }));
 }
 
 void SerialInput::saw_good_message()
@@ -243,6 +310,7 @@ void SerialInput::saw_good_message()
         std::cerr << what() << ": autobaud selected " << baud_rate << " bps" << std::endl;
         autobauding = false;
         autobaud_timer.cancel();
+        state_learned();
     }
 }
 
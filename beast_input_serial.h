@@ -31,6 +31,7 @@
 #include <boost/asio/serial_port.hpp>
 
 #include "beast_input.h"
+#include "handler_memory.h"
 
 namespace beast {
     class SerialInput : public BeastInput {
@@ -76,6 +77,12 @@ namespace beast {
         void try_to_connect(void) override;
         void disconnect(void) override;
         bool low_level_write(std::shared_ptr<helpers::bytebuf> message) override;
+        int native_handle(void) override;
+        void suspend_reading(void) override;
+        void resume_reading(void) override;
+        void save_connection_state(std::ostream &os) const override;
+        void restore_connection_state(std::istream &is) override;
+        bool adopt_connection(int fd, std::istream &is) override;
         void saw_good_message(void) override;
         bool can_dispatch(void) const override;
 
@@ -123,6 +130,10 @@ namespace beast {
         // cached buffer used for reads
         std::shared_ptr<helpers::bytebuf> readbuf;
 
+        // recycled handler memory for the read loop and read_timer
+        helpers::HandlerMemory read_memory;
+        helpers::HandlerMemory timer_memory;
+
         // have we warned about a possibly bad baud rate?
         bool warned_about_rate;
     };
@@ -23,9 +23,13 @@
 // OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <cerrno>
 #include <iomanip>
 #include <iostream>
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <boost/asio.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/asio/ip/v6_only.hpp>
@@ -37,47 +41,95 @@ namespace asio = boost::asio;
 using boost::asio::ip::tcp;
 
 namespace beast {
+    modes::Filter OutputOptions::to_filter(const Settings &settings) const
+    {
+        modes::Filter f = settings.to_filter();
+
+        // The DF list narrows what the settings asked for, so it also
+        // narrows what we ask the receiver for.
+        for (std::size_t df = 0; df < f.receive_df.size(); ++df)
+            f.receive_df[df] = f.receive_df[df] && (df_mask & (1U << df));
+
+        f.receive_typecodes = typecode_mask;
+        f.min_signal = min_signal;
+        if (crc_good_only)
+            f.receive_bad_crc = false;
+        f.address_allow = address_allow;
+        f.address_deny = address_deny;
+        return f;
+    }
+
+    //////////////
+
     enum class SocketOutput::ParserState { FIND_1A, READ_1, READ_OPTION };
 
     SocketOutput::SocketOutput(asio::io_service &service_,
                                tcp::socket &&socket_,
-                               const Settings &settings_)
+                               const Settings &settings_,
+                               const OutputOptions &options_)
         : service(service_),
           socket(std::move(socket_)),
           peer(socket.remote_endpoint()),
           state(ParserState::FIND_1A),
+          commandbuf(command_buffer_size),
           settings(settings_),
-          flush_pending(false)
+          format(options_.format),
+          sbs_encoder(options_.sbs_encoder),
+          encode_pool(format != OutputFormat::BEAST ? options_.encode_pool : nullptr),
+          encode_scheduled(false),
+          encode_in_flight(false),
+          reorder_timer(service_),
+          reorder_timer_pending(false),
+          last_gps_seconds(0),
+          gps_days(0),
+          flush_pending(false),
+          queue_limit(options_.queue_limit),
+          queue_overflowing(false),
+          queue_dropped(0)
     {
+        boost::system::error_code ignored;
+        if (options_.send_buffer_size > 0)
+            socket.set_option(asio::socket_base::send_buffer_size(options_.send_buffer_size), ignored);
+        if (options_.no_delay)
+            socket.set_option(tcp::no_delay(true), ignored);
+
+        if (options_.rate_limit_count > 0)
+            rate_limiter.reset(new modes::RateLimiter(options_.rate_limit_count, options_.rate_limit_interval));
+        if (options_.reorder_hold.count() > 0)
+            reorder.reset(new modes::ReorderBuffer(options_.reorder_hold));
+        if (format == OutputFormat::SBS && !sbs_encoder)
+            sbs_encoder = std::make_shared<sbs::Encoder>();
+
+        select_encoder();
     }
 
     void SocketOutput::start()
     {
-        read_commands();
+        read_commands(shared_from_this());
     }
 
-    void SocketOutput::read_commands()
+    void SocketOutput::read_commands(pointer self)
     {
-        auto self(shared_from_this());
-        auto buf = std::make_shared< std::vector<std::uint8_t> >(512);
-
-        socket.async_read_some(asio::buffer(*buf),
-                               [this,self,buf] (const boost::system::error_code &ec, std::size_t len) {
-                                   if (ec) {
-                                       handle_error(ec);
-                                   } else {
-                                       buf->resize(len);
-                                       process_commands(*buf);
-                                       read_commands();
-                                   }
-                               });
+        // The same buffer is reused for every read, and the reference to
+        // ourselves is handed from one read to the next rather than taken
+        // afresh, so the steady-state loop neither allocates a buffer nor
+        // touches the reference count.
+        socket.async_read_some(asio::buffer(commandbuf),
+                               helpers::recycle(read_memory, [this,self] (const boost::system::error_code &ec, std::size_t len) mutable {
+                                       if (ec) {
+                                           handle_error(ec);
+                                       } else {
+                                           process_commands(commandbuf, len);
+                                           read_commands(std::move(self));
+                                       }
+                                   }));
     }
 
-    void SocketOutput::process_commands(std::vector<std::uint8_t> data)
+    void SocketOutput::process_commands(const helpers::bytebuf &data, std::size_t len)
     {
         bool got_a_command = false;
 
-        for (auto p = data.begin(); p != data.end(); ++p) {
+        for (auto p = data.begin(); p != data.begin() + len; ++p) {
             switch (state) {
             case ParserState::FIND_1A:
                 if (*p == 0x1A)
@@ -102,6 +154,7 @@ namespace beast {
         if (got_a_command) {
             // just do this once at the end, not on every command
             std::cerr << peer << ": settings changed to " << settings << std::endl;
+            select_encoder();
             if (settings_notifier)
                 settings_notifier(settings);
         }
@@ -157,67 +210,206 @@ namespace beast {
         if (!socket.is_open())
             return; // we are shut down
 
-        if (message.type() == modes::MessageType::STATUS) {
-            // local connection settings override the upstream data
-            Settings upstream = Settings(message.data()[0]);
-            Settings used = settings | upstream;
-
-            auto copy = message.data();
-            copy[0] = used.to_status_byte();
+        if (queue_limit > 0) {
+            if (queued_bytes() >= queue_limit) {
+                if (!queue_overflowing) {
+                    std::cerr << peer << ": not keeping up, dropping messages" << std::endl;
+                    queue_overflowing = true;
+                }
+                ++queue_dropped;
+                return;
+            }
 
-            if (settings.gps_timestamps.on() && !upstream.gps_timestamps.on()) {
-                // we are translating 12MHz to "GPS", set the emulation flag
-                copy[2] |= 0x80; // set UTC-bugfix-and-more-bits flag
-                copy[2] |= 0x20; // set emulated-timestamp flag
+            if (queue_overflowing) {
+                std::cerr << peer << ": caught up after dropping " << queue_dropped << " messages" << std::endl;
+                queue_overflowing = false;
+                queue_dropped = 0;
             }
+        }
+
+        if (rate_limiter && !(*rate_limiter)(message))
+            return;
+
+        if (reorder && modes::ReorderBuffer::reorderable(message)) {
+            reorder->push(message, [this] (const modes::Message &m) { forward(m); });
+            schedule_reorder_flush();
+            return;
+        }
+
+        forward(message);
+    }
+
+    void SocketOutput::schedule_reorder_flush()
+    {
+        // release held messages on time even if no more data arrives
+        if (reorder_timer_pending || reorder->empty())
+            return;
+
+        auto self(shared_from_this());
+        reorder_timer_pending = true;
+        reorder_timer.expires_at(reorder->deadline());
+        reorder_timer.async_wait(helpers::recycle(timer_memory, [this,self] (const boost::system::error_code &ec) {
+                    reorder_timer_pending = false;
+                    if (ec || !socket.is_open())
+                        return;
+
+                    reorder->release(modes::ReorderBuffer::clock::now(), [this] (const modes::Message &m) { forward(m); });
+                    schedule_reorder_flush();
+                }));
+    }
+
+    void SocketOutput::forward(const modes::Message &message)
+    {
+        (this->*encoder)(message);
+    }
+
+    void SocketOutput::select_encoder()
+    {
+        if (format != OutputFormat::BEAST) {
+            encoder = &SocketOutput::encode_text_message;
+            return;
+        }
+
+        switch (timestamp_conversion(settings)) {
+        case TimestampConversion::TO_GPS:
+            encoder = beast_encoder<TimestampConversion::TO_GPS>();
+            break;
+        case TimestampConversion::TO_12MHZ:
+            encoder = beast_encoder<TimestampConversion::TO_12MHZ>();
+            break;
+        default:
+            encoder = beast_encoder<TimestampConversion::NONE>();
+            break;
+        }
+    }
+
+    template <SocketOutput::TimestampConversion T>
+    SocketOutput::Encoder SocketOutput::beast_encoder() const
+    {
+        if (settings.binary_format) {
+            if (settings.gps_timestamps.on())
+                return &SocketOutput::encode_binary<T, true>;
+            else
+                return &SocketOutput::encode_binary<T, false>;
+        } else if (settings.avrmlat) {
+            return &SocketOutput::encode_avrmlat<T>;
+        } else {
+            return &SocketOutput::encode_avr<T>;
+        }
+    }
 
-            write_message(message.type(),
-                          message.timestamp_type(),
-                          message.timestamp(),
-                          message.signal(),
-                          copy);
+    template <SocketOutput::TimestampConversion T, bool EMULATE_GPS>
+    void SocketOutput::encode_binary(const modes::Message &message)
+    {
+        std::uint64_t timestamp = convert_timestamp<T>(message.timestamp_type(), message.timestamp());
+
+        if (message.type() != modes::MessageType::STATUS) {
+            write_binary(message.type(), timestamp, message.signal(), message.data());
+            return;
+        }
+
+        // local connection settings override the upstream data
+        Settings upstream = Settings(message.data()[0]);
+        Settings used = settings | upstream;
+
+        auto copy = message.data();
+        copy[0] = used.to_status_byte();
+
+        if (EMULATE_GPS && !upstream.gps_timestamps.on()) {
+            // we are translating 12MHz to "GPS", set the emulation flag
+            copy[2] |= 0x80; // set UTC-bugfix-and-more-bits flag
+            copy[2] |= 0x20; // set emulated-timestamp flag
+        }
+
+        write_binary(message.type(), timestamp, message.signal(), copy);
+    }
+
+    // The AVR encoders still convert timestamps they don't send, so that
+    // the midnight rollover is tracked if the client later switches format.
+
+    template <SocketOutput::TimestampConversion T>
+    void SocketOutput::encode_avrmlat(const modes::Message &message)
+    {
+        std::uint64_t timestamp = convert_timestamp<T>(message.timestamp_type(), message.timestamp());
+        if (message.type() != modes::MessageType::STATUS && message.type() != modes::MessageType::POSITION)
+            write_avrmlat(timestamp, message.data());
+    }
+
+    template <SocketOutput::TimestampConversion T>
+    void SocketOutput::encode_avr(const modes::Message &message)
+    {
+        convert_timestamp<T>(message.timestamp_type(), message.timestamp());
+        if (message.type() != modes::MessageType::STATUS && message.type() != modes::MessageType::POSITION)
+            write_avr(message.data());
+    }
+
+    void SocketOutput::encode_text_message(const modes::Message &message)
+    {
+        if (message.type() != modes::MessageType::MODE_AC &&
+            message.type() != modes::MessageType::MODE_S_SHORT &&
+            message.type() != modes::MessageType::MODE_S_LONG)
+            return;
+
+        if (encode_pool) {
+            queue_encode(message);
         } else {
-            write_message(message.type(),
-                          message.timestamp_type(),
-                          message.timestamp(),
-                          message.signal(),
-                          message.data());
+            prepare_write();
+            encode_text(message, settings, *outbuf);
+            complete_write();
         }
     }
 
-    void SocketOutput::write_message(modes::MessageType type,
-                                     modes::TimestampType timestamp_type,
-                                     std::uint64_t timestamp,
-                                     std::uint8_t signal,
-                                     const helpers::bytebuf &data)
+    SocketOutput::TimestampConversion SocketOutput::timestamp_conversion(const Settings &use_settings)
     {
-        if (timestamp_type == modes::TimestampType::TWELVEMEG && !settings.radarcape.off() && settings.gps_timestamps.on()) {
+        if (!use_settings.radarcape.off() && use_settings.gps_timestamps.on()) {
             // GPS timestamps were explicitly requested
+            return TimestampConversion::TO_GPS;
+        } else if (use_settings.radarcape.off() || use_settings.gps_timestamps.off()) {
+            // beast output or 12MHz timestamps were explicitly requested
+            return TimestampConversion::TO_12MHZ;
+        } else {
+            // if gps_timestamps is DONTCARE, we just use whatever is provided
+            return TimestampConversion::NONE;
+        }
+    }
+
+    std::uint64_t SocketOutput::convert_timestamp(const Settings &use_settings, modes::TimestampType timestamp_type, std::uint64_t timestamp)
+    {
+        switch (timestamp_conversion(use_settings)) {
+        case TimestampConversion::TO_GPS:
+            return convert_timestamp<TimestampConversion::TO_GPS>(timestamp_type, timestamp);
+        case TimestampConversion::TO_12MHZ:
+            return convert_timestamp<TimestampConversion::TO_12MHZ>(timestamp_type, timestamp);
+        default:
+            return timestamp;
+        }
+    }
+
+    template <SocketOutput::TimestampConversion T>
+    std::uint64_t SocketOutput::convert_timestamp(modes::TimestampType timestamp_type, std::uint64_t timestamp)
+    {
+        if (T == TimestampConversion::TO_GPS && timestamp_type == modes::TimestampType::TWELVEMEG) {
             // scale 12MHz to pseudo-GPS
             std::uint64_t ns = timestamp * 1000ULL / 12ULL;
             std::uint64_t seconds = (ns / 1000000000ULL) % 86400;
             std::uint64_t nanos = ns % 1000000000ULL;
             timestamp = (seconds << 30) | nanos;
-        } else if (timestamp_type == modes::TimestampType::GPS && (settings.radarcape.off() || settings.gps_timestamps.off())) {
-            // beast output or 12MHz timestamps were explicitly requested
+        } else if (T == TimestampConversion::TO_12MHZ && timestamp_type == modes::TimestampType::GPS) {
             // scale GPS to 12MHz
             std::uint64_t seconds = timestamp >> 30;
             std::uint64_t nanos = timestamp & 0x3FFFFFFF;
-            std::uint64_t ns = seconds * 1000000000ULL + nanos;
-            timestamp = ns * 12ULL / 1000ULL;
-        }
 
-        // if gps_timestamps is DONTCARE, we just use whatever is provided
+            // GPS timestamps wrap at midnight; carry on counting so the
+            // 12MHz clock we emit doesn't go backwards
+            if (seconds + 43200 < last_gps_seconds)
+                ++gps_days;
+            last_gps_seconds = seconds;
 
-        if (settings.binary_format) {
-            write_binary(type, timestamp, signal, data);
-        } else if (settings.avrmlat) {
-            if (type != modes::MessageType::STATUS && type != modes::MessageType::POSITION)
-                write_avrmlat(timestamp, data);
-        } else {
-            if (type != modes::MessageType::STATUS && type != modes::MessageType::POSITION)
-                write_avr(data);
+            std::uint64_t ns = (seconds + gps_days * 86400ULL) * 1000000000ULL + nanos;
+            timestamp = ns * 12ULL / 1000ULL;
         }
+
+        return timestamp;
     }
 
     void SocketOutput::prepare_write()
@@ -232,10 +424,16 @@ namespace beast {
     {
         if (!flush_pending && !outbuf->empty()) {
             flush_pending = true;
-            service.post(std::bind(&SocketOutput::flush_outbuf, shared_from_this()));
+            service.post(helpers::recycle(post_memory, std::bind(&SocketOutput::flush_outbuf, shared_from_this())));
         }
     }
 
+    std::size_t SocketOutput::queued_bytes() const
+    {
+        // messages waiting to be encoded are counted at a typical line length
+        return (outbuf ? outbuf->size() : 0) + encode_queue.size() * 64;
+    }
+
     void SocketOutput::flush_outbuf()
     {
         if (!outbuf || outbuf->empty())
@@ -246,22 +444,22 @@ namespace beast {
 
         auto self(shared_from_this());
         async_write(socket, boost::asio::buffer(*writebuf),
-                    [this,self,writebuf] (const boost::system::error_code &ec, size_t len) {
-                        // NB: we only reset the pending flag here,
-                        // because async_write is a composed operation
-                        // that might take a while to complete, and
-                        // if we do another write before it completes
-                        // then it might interleave data.
-                        flush_pending = false;
-
-                        if (!outbuf) {
-                            writebuf->clear();
-                            outbuf = writebuf;
-                        }
-
-                        if (ec)
-                            handle_error(ec);
-                    });
+                    helpers::recycle(write_memory, [this,self,writebuf] (const boost::system::error_code &ec, size_t len) {
+                            // NB: we only reset the pending flag here,
+                            // because async_write is a composed operation
+                            // that might take a while to complete, and
+                            // if we do another write before it completes
+                            // then it might interleave data.
+                            flush_pending = false;
+
+                            if (!outbuf) {
+                                writebuf->clear();
+                                outbuf = writebuf;
+                            }
+
+                            if (ec)
+                                handle_error(ec);
+                        }));
     }
 
     static inline void push_back_beast(helpers::bytebuf &v, std::uint8_t b)
@@ -305,13 +503,19 @@ namespace beast {
         v.push_back((std::uint8_t) hexdigits[b & 0x0F]);
     }
 
+    static inline void append_hex(helpers::bytebuf &v, const helpers::bytebuf &data)
+    {
+        std::size_t start = v.size();
+        v.resize(start + data.size() * 2);
+        helpers::kernels.hex_encode(data.data(), data.size(), (char *) &v[start], true);
+    }
+
     void SocketOutput::write_avr(const helpers::bytebuf &data)
     {
         prepare_write();
 
         outbuf->push_back((std::uint8_t) '*');
-        for (auto b : data)
-            push_back_hex(*outbuf, b);
+        append_hex(*outbuf, data);
         outbuf->push_back((std::uint8_t) ';');
         outbuf->push_back((std::uint8_t) '\n');
 
@@ -329,14 +533,151 @@ namespace beast {
         push_back_hex(*outbuf, (timestamp >> 16) & 0xFF);
         push_back_hex(*outbuf, (timestamp >> 8) & 0xFF);
         push_back_hex(*outbuf, timestamp & 0xFF);
-        for (auto b : data)
-            push_back_hex(*outbuf, b);
+        append_hex(*outbuf, data);
         outbuf->push_back((std::uint8_t) ';');
         outbuf->push_back((std::uint8_t) '\n');
 
         complete_write();
     }
 
+    // One JSON object per line, e.g.
+    //   {"df":17,"icao":"4ca1fa","tc":11,"timestamp":123456,"signal":80,"hex":"8d4ca1fa58..."}
+    // Fields that don't apply to the message are left out.
+    static void format_json(const modes::Message &message, std::uint64_t timestamp, helpers::TextBuffer &line)
+    {
+        if (message.type() == modes::MessageType::MODE_AC) {
+            line.put("{\"modeac\":\"").put_hex(message.squawk(), 4).put('"');
+        } else {
+            line.put("{\"df\":").put_uint(message.df());
+            if (message.address() >= 0)
+                line.put(",\"icao\":\"").put_hex(message.address(), 6).put('"');
+            if (message.typecode() >= 0)
+                line.put(",\"tc\":").put_uint(message.typecode());
+            if (message.squawk() >= 0)
+                line.put(",\"squawk\":\"").put_hex(message.squawk(), 4).put('"');
+            if (message.crc_bad())
+                line.put(",\"crc_bad\":true");
+        }
+
+        line.put(",\"timestamp\":").put_uint(timestamp);
+        line.put(",\"signal\":").put_uint(message.signal());
+        line.put(",\"hex\":\"").put_hex(message.data()).put("\"}\n");
+    }
+
+    // Comma-separated, one message per line:
+    //   timestamp,signal,df,icao,tc,squawk,crc_bad,hex
+    // Fields that don't apply to the message are empty; df is empty for
+    // Mode A/C.
+    static void format_csv(const modes::Message &message, std::uint64_t timestamp, helpers::TextBuffer &line)
+    {
+        line.put_uint(timestamp).put(',').put_uint(message.signal()).put(',');
+        if (message.df() >= 0)
+            line.put_uint(message.df());
+        line.put(',');
+        if (message.address() >= 0)
+            line.put_hex(message.address(), 6);
+        line.put(',');
+        if (message.typecode() >= 0)
+            line.put_uint(message.typecode());
+        line.put(',');
+        if (message.squawk() >= 0)
+            line.put_hex(message.squawk(), 4);
+        line.put(',').put(message.crc_bad() ? '1' : '0').put(',');
+        line.put_hex(message.data()).put('\n');
+    }
+
+    // Append one message in a text format to 'out'. This runs on the
+    // encode pool if there is one, so it must only touch the message, the
+    // given settings, the (locked) SBS encoder and the timestamp state.
+    void SocketOutput::encode_text(const modes::Message &message, const Settings &use_settings, helpers::bytebuf &out)
+    {
+        if (format == OutputFormat::SBS) {
+            sbs_encoder->render(message, out);
+            return;
+        }
+
+        helpers::TextBuffer line;
+        std::uint64_t timestamp = convert_timestamp(use_settings, message.timestamp_type(), message.timestamp());
+        if (format == OutputFormat::JSON)
+            format_json(message, timestamp, line);
+        else
+            format_csv(message, timestamp, line);
+        line.append_to(out);
+    }
+
+    void SocketOutput::queue_encode(const modes::Message &message)
+    {
+        encode_queue.push_back(message);
+
+        // collect everything from this distribution cycle into one batch
+        if (!encode_scheduled && !encode_in_flight) {
+            encode_scheduled = true;
+            service.post(std::bind(&SocketOutput::start_encode, shared_from_this()));
+        }
+    }
+
+    void SocketOutput::start_encode()
+    {
+        encode_scheduled = false;
+        if (encode_in_flight || encode_queue.empty() || !socket.is_open())
+            return;
+
+        auto self(shared_from_this());
+        auto batch = std::make_shared<std::vector<modes::Message>>();
+        batch->swap(encode_queue);
+        Settings use_settings = settings; // may change on this thread while the pool works
+
+        encode_in_flight = true;
+        encode_pool->submit([this,self,batch,use_settings] {
+                auto encoded = std::make_shared<helpers::bytebuf>();
+                encoded->reserve(batch->size() * 64);
+                for (const auto &message : *batch)
+                    encode_text(message, use_settings, *encoded);
+                service.post(std::bind(&SocketOutput::finish_encode, self, encoded));
+            });
+    }
+
+    void SocketOutput::finish_encode(std::shared_ptr<helpers::bytebuf> encoded)
+    {
+        encode_in_flight = false;
+        if (!socket.is_open())
+            return;
+
+        if (!encoded->empty()) {
+            prepare_write();
+            outbuf->insert(outbuf->end(), encoded->begin(), encoded->end());
+            complete_write();
+        }
+
+        // messages that arrived while we were busy
+        start_encode();
+    }
+
+    void SocketOutput::drain()
+    {
+        if (!socket.is_open())
+            return;
+
+        if (reorder) {
+            reorder->flush([this] (const modes::Message &m) { forward(m); });
+            reorder_timer.cancel();
+        }
+
+        // data queued behind a write that has since completed is not
+        // flushed until the next message arrives, and none will
+        if (outbuf && !outbuf->empty() && !flush_pending)
+            complete_write();
+    }
+
+    bool SocketOutput::drained() const
+    {
+        if (!socket.is_open())
+            return true;
+
+        return (!flush_pending && (!outbuf || outbuf->empty()) &&
+                !encode_scheduled && !encode_in_flight && encode_queue.empty());
+    }
+
     void SocketOutput::handle_error(const boost::system::error_code &ec)
     {
         if (ec == boost::asio::error::eof) {
@@ -350,6 +691,23 @@ namespace beast {
 
     void SocketOutput::close()
     {
+        if (queue_overflowing && socket.is_open())
+            std::cerr << peer << ": dropped " << queue_dropped << " messages before disconnecting" << std::endl;
+
+        if (reorder && socket.is_open()) {
+            const auto &stats = reorder->stats();
+            if (stats.messages > 0) {
+                auto mean = std::chrono::duration_cast<std::chrono::microseconds>(stats.total_delay / stats.messages);
+                auto max = std::chrono::duration_cast<std::chrono::microseconds>(stats.max_delay);
+                std::cerr << peer << ": reordered " << stats.messages << " messages"
+                          << ", added latency mean " << (mean.count() / 1000.0) << "ms"
+                          << " max " << (max.count() / 1000.0) << "ms"
+                          << ", " << stats.late << " late"
+                          << ", " << stats.overflows << " overflowed" << std::endl;
+            }
+            reorder_timer.cancel();
+        }
+
         socket.close();
         if (close_notifier)
             close_notifier();
@@ -360,13 +718,15 @@ namespace beast {
     SocketListener::SocketListener(asio::io_service &service_,
                                    const tcp::endpoint &endpoint_,
                                    modes::FilterDistributor &distributor_,
-                                   const Settings &initial_settings_)
+                                   const Settings &initial_settings_,
+                                   const OutputOptions &options_)
         : service(service_),
           acceptor(service_),
           endpoint(endpoint_),
           socket(service_),
           distributor(distributor_),
-          initial_settings(initial_settings_)
+          initial_settings(initial_settings_),
+          options(options_)
     {
     }
 
@@ -400,20 +760,7 @@ namespace beast {
                               [this,self] (const boost::system::error_code &ec) {
                                   if (!ec) {
                                       std::cerr << endpoint << ": accepted a connection from " << peer << " with settings " << initial_settings << std::endl;
-                                      SocketOutput::pointer new_output = SocketOutput::create(service, std::move(socket), initial_settings);
-
-                                      modes::FilterDistributor::handle h = distributor.add_client(std::bind(&SocketOutput::write, new_output, std::placeholders::_1),
-                                                                                                  initial_settings.to_filter());
-
-                                      new_output->set_settings_notifier([this,self,h] (const Settings &newsettings) {
-                                              distributor.update_client_filter(h, newsettings.to_filter());
-                                          });
-
-                                      new_output->set_close_notifier([this,self,h] {
-                                              distributor.remove_client(h);
-                                          });
-
-                                      new_output->start();
+                                      new_connection(std::move(socket), initial_settings);
                                   } else {
                                       if (ec == boost::system::errc::operation_canceled)
                                           return;
@@ -424,13 +771,68 @@ namespace beast {
                               });
     }
 
+    void SocketListener::new_connection(tcp::socket &&new_socket, const Settings &settings)
+    {
+        auto self(shared_from_this());
+
+        SocketOutput::pointer new_output = SocketOutput::create(service, std::move(new_socket), settings, options);
+
+        modes::FilterDistributor::handle h = distributor.add_client(std::bind(&SocketOutput::write, new_output, std::placeholders::_1),
+                                                                    options.to_filter(settings));
+        outputs[h] = new_output;
+
+        new_output->set_settings_notifier([this,self,h] (const Settings &newsettings) {
+                distributor.update_client_filter(h, options.to_filter(newsettings));
+            });
+
+        new_output->set_close_notifier([this,self,h] {
+                distributor.remove_client(h);
+                outputs.erase(h);
+            });
+
+        new_output->start();
+    }
+
+    void SocketListener::start(int inherited_fd)
+    {
+        acceptor.assign(endpoint.protocol(), inherited_fd);
+        accept_connection();
+    }
+
+    void SocketListener::adopt(int fd, const Settings &settings)
+    {
+        tcp::socket adopted(service);
+
+        try {
+            adopted.assign(endpoint.protocol(), fd);
+            std::cerr << endpoint << ": took over a connection from " << adopted.remote_endpoint() << " with settings " << settings << std::endl;
+            new_connection(std::move(adopted), settings);
+        } catch (const boost::system::system_error &err) {
+            // most likely the client went away during the handoff
+            std::cerr << endpoint << ": could not take over a connection: " << err.what() << std::endl;
+            if (!adopted.is_open())
+                ::close(fd);
+        }
+    }
+
+    std::vector<SocketOutput::pointer> SocketListener::connected_outputs() const
+    {
+        std::vector<SocketOutput::pointer> result;
+        for (const auto &o : outputs) {
+            if (auto output = o.second.lock())
+                result.push_back(output);
+        }
+        return result;
+    }
+
     //////////////
 
     SocketConnector::SocketConnector(asio::io_service &service_,
                                      const std::string &host_,
                                      const std::string &port_or_service_,
                                      modes::FilterDistributor &distributor_,
-                                     const Settings &initial_settings_)
+                                     const Settings &initial_settings_,
+                                     const OutputOptions &options_)
         : service(service_),
           resolver(service_),
           socket(service_),
@@ -439,6 +841,7 @@ namespace beast {
           port_or_service(port_or_service_),
           distributor(distributor_),
           initial_settings(initial_settings_),
+          options(options_),
           running(false)
     {
     }
@@ -455,6 +858,9 @@ namespace beast {
         resolver.cancel();
         reconnect_timer.cancel();
         socket.close();
+
+        if (auto current = output.lock())
+            current->close();
     }
 
     void SocketConnector::resolve_and_connect(const boost::system::error_code &ec)
@@ -504,7 +910,7 @@ namespace beast {
         socket.async_connect(endpoint,
                              [this,self,endpoint] (const boost::system::error_code &ec) {
                                  if (!ec) {
-                                     connection_established(endpoint);
+                                     connection_established(endpoint, initial_settings);
                                  } else if (ec == boost::asio::error::operation_aborted) {
                                      return;
                                  } else {
@@ -528,18 +934,49 @@ namespace beast {
         }
     }
 
-    void SocketConnector::connection_established(const tcp::endpoint &endpoint)
+    void SocketConnector::adopt(int fd, const Settings &settings)
+    {
+        running = true;
+
+        struct sockaddr_storage addr;
+        socklen_t addrlen = sizeof(addr);
+        boost::system::error_code ec;
+        if (::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addrlen) < 0)
+            ec = boost::system::error_code(errno, boost::system::system_category());
+        else
+            socket.assign(addr.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), fd, ec);
+
+        tcp::endpoint endpoint;
+        if (!ec)
+            endpoint = socket.remote_endpoint(ec);
+
+        if (ec) {
+            // the connection went away during the handoff; start over
+            std::cerr << host << ":" << port_or_service << ": could not take over connection: " << ec.message() << std::endl;
+            if (socket.is_open())
+                socket.close(ec);
+            else
+                ::close(fd);
+            resolve_and_connect();
+            return;
+        }
+
+        std::cerr << host << ":" << port_or_service << ": took over connection to " << endpoint << std::endl;
+        connection_established(endpoint, settings);
+    }
+
+    void SocketConnector::connection_established(const tcp::endpoint &endpoint, const Settings &settings)
     {
         auto self(shared_from_this());
 
-        std::cerr << host << ":" << port_or_service << ": connected to " << endpoint << " with settings " << initial_settings << std::endl;
-        SocketOutput::pointer new_output = SocketOutput::create(service, std::move(socket), initial_settings);
+        std::cerr << host << ":" << port_or_service << ": connected to " << endpoint << " with settings " << settings << std::endl;
+        SocketOutput::pointer new_output = SocketOutput::create(service, std::move(socket), settings, options);
 
         modes::FilterDistributor::handle h = distributor.add_client(std::bind(&SocketOutput::write, new_output, std::placeholders::_1),
-                                                                    initial_settings.to_filter());
+                                                                    options.to_filter(settings));
 
         new_output->set_settings_notifier([this,self,h] (const Settings &newsettings) {
-                distributor.update_client_filter(h, newsettings.to_filter());
+                distributor.update_client_filter(h, options.to_filter(newsettings));
             });
 
         new_output->set_close_notifier([this,self,h] {
@@ -547,6 +984,7 @@ namespace beast {
                 schedule_reconnect();
             });
 
+        output = new_output;
         new_output->start();
     }
 };
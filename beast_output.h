@@ -28,14 +28,22 @@
 #ifndef BEAST_OUTPUT_H
 #define BEAST_OUTPUT_H
 
+#include <map>
 #include <memory>
+#include <vector>
 
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/steady_timer.hpp>
 
 #include "modes_message.h"
+#include "modes_filter.h"
+#include "modes_rate_limiter.h"
+#include "modes_reorder_buffer.h"
 #include "beast_settings.h"
+#include "handler_memory.h"
+#include "sbs_encoder.h"
+#include "work_pool.h"
 
 namespace beast {
     inline std::uint8_t messagetype_to_byte(modes::MessageType t)
@@ -49,18 +57,95 @@ namespace beast {
         }
     }
 
+    // Output format. BEAST means whatever the client's settings ask for
+    // (Beast binary, AVR or AVR-MLAT); the others are fixed line-oriented
+    // text formats for consumers that don't want to decode Mode S. SBS is
+    // BaseStation port-30003 style text.
+    enum class OutputFormat { BEAST, JSON, CSV, SBS };
+
+    // Per-output options. Unlike Settings, these are fixed when the output
+    // is configured and can't be changed by the client.
+    struct OutputOptions {
+        OutputOptions()
+            : df_mask(0xFFFFFFFF),
+              typecode_mask(0xFFFFFFFF),
+              min_signal(0),
+              crc_good_only(false),
+              rate_limit_count(0),
+              rate_limit_interval(std::chrono::seconds(1)),
+              reorder_hold(0),
+              queue_limit(0),
+              send_buffer_size(0),
+              no_delay(false),
+              format(OutputFormat::BEAST),
+              encode_pool(nullptr)
+        {}
+
+        // bit N clear: never forward DF N, whatever the settings allow
+        std::uint32_t df_mask;
+
+        // bit N set: forward extended squitter with ME type code N
+        std::uint32_t typecode_mask;
+
+        // don't forward Mode A/C or Mode S messages weaker than this
+        std::uint8_t min_signal;
+
+        // never forward messages with bad CRCs, even if the client asks
+        bool crc_good_only;
+
+        // if set, only forward Mode S messages from these addresses
+        std::shared_ptr<const modes::AddressSet> address_allow;
+
+        // if set, don't forward Mode S messages from these addresses
+        std::shared_ptr<const modes::AddressSet> address_deny;
+
+        // if non-zero, forward at most rate_limit_count messages per
+        // aircraft and message type in any rate_limit_interval
+        unsigned rate_limit_count;
+        std::chrono::milliseconds rate_limit_interval;
+
+        // if non-zero, hold messages for up to this long and forward them
+        // in timestamp order
+        std::chrono::milliseconds reorder_hold;
+
+        // if non-zero, drop messages rather than queue more than about
+        // this many bytes for a client that isn't keeping up
+        std::size_t queue_limit;
+
+        // socket tuning: SO_SNDBUF (0 for the system default) and
+        // TCP_NODELAY
+        int send_buffer_size;
+        bool no_delay;
+
+        OutputFormat format;
+
+        // renders SBS lines; outputs sharing an encoder only format each
+        // message once. Created on demand if not set.
+        std::shared_ptr<sbs::Encoder> sbs_encoder;
+
+        // if set, text formats are encoded in batches on this pool rather
+        // than on the I/O thread. The pool must outlive the io_service's
+        // run loop.
+        helpers::WorkPool *encode_pool;
+
+        // build the filter for a client using the given settings
+        modes::Filter to_filter(const Settings &settings) const;
+    };
+
     class SocketOutput : public std::enable_shared_from_this<SocketOutput> {
     public:
         typedef std::shared_ptr<SocketOutput> pointer;
 
         const unsigned int read_buffer_size = 4096;
+        const unsigned int command_buffer_size = 512;
 
         // factory method, this class must always be constructed via make_shared
         static pointer create(boost::asio::io_service &service,
                               boost::asio::ip::tcp::socket &&socket,
-                              const Settings &settings = Settings())
+                              const Settings &settings = Settings(),
+                              const OutputOptions &options = OutputOptions())
         {
-            return pointer(new SocketOutput(service, std::move(socket), settings));
+            return pointer(new SocketOutput(service, std::move(socket), settings, options));
         }
 
         void start();
@@ -76,22 +161,50 @@ namespace beast {
 
         void write(const modes::Message &message);
 
+        // Handing the connection to a replacement process: drain() sends
+        // everything held or buffered, and drained() is true once it has
+        // all been written, after which native_handle() and
+        // current_settings() describe the client.
+        void drain();
+        bool drained() const;
+        int native_handle() { return socket.native_handle(); }
+        const Settings &current_settings() const { return settings; }
+
     private:
         SocketOutput(boost::asio::io_service &service_,
                      boost::asio::ip::tcp::socket &&socket_,
-                     const Settings &settings_);
+                     const Settings &settings_,
+                     const OutputOptions &options_);
 
-        void read_commands();
-        void process_commands(std::vector<std::uint8_t> data);
+        void read_commands(pointer self);
+        void process_commands(const helpers::bytebuf &data, std::size_t len);
         void process_option_command(uint8_t option);
 
         void handle_error(const boost::system::error_code &ec);
 
-        void write_message(modes::MessageType type,
-                           modes::TimestampType timestamp_type,
-                           std::uint64_t timestamp,
-                           std::uint8_t signal,
-                           const helpers::bytebuf &data);
+        void forward(const modes::Message &message);
+        void schedule_reorder_flush();
+
+        // How timestamps are rewritten for a client, which depends only
+        // on its settings (and the timestamp type of each message).
+        enum class TimestampConversion { NONE, TO_GPS, TO_12MHZ };
+        static TimestampConversion timestamp_conversion(const Settings &use_settings);
+
+        template <TimestampConversion T>
+        std::uint64_t convert_timestamp(modes::TimestampType timestamp_type, std::uint64_t timestamp);
+        std::uint64_t convert_timestamp(const Settings &use_settings, modes::TimestampType timestamp_type, std::uint64_t timestamp);
+
+        // Writes one message in the client's current format. One of the
+        // encode_* instantiations below, chosen by select_encoder() when
+        // the settings change, so the per-message path tests no settings.
+        typedef void (SocketOutput::*Encoder)(const modes::Message &message);
+        void select_encoder();
+        template <TimestampConversion T> Encoder beast_encoder() const;
+
+        template <TimestampConversion T, bool EMULATE_GPS> void encode_binary(const modes::Message &message);
+        template <TimestampConversion T> void encode_avrmlat(const modes::Message &message);
+        template <TimestampConversion T> void encode_avr(const modes::Message &message);
+        void encode_text_message(const modes::Message &message);
 
         void write_binary(modes::MessageType type,
                           std::uint64_t timestamp,
@@ -103,9 +216,15 @@ namespace beast {
 
         void write_avr(const helpers::bytebuf &data);
 
+        void encode_text(const modes::Message &message, const Settings &use_settings, helpers::bytebuf &out);
+        void queue_encode(const modes::Message &message);
+        void start_encode();
+        void finish_encode(std::shared_ptr<helpers::bytebuf> encoded);
+
         void prepare_write();
         void complete_write();
         void flush_outbuf();
+        std::size_t queued_bytes() const;
 
         boost::asio::io_service &service;
         boost::asio::ip::tcp::socket socket;
@@ -113,14 +232,49 @@ namespace beast {
 
         enum class ParserState;
         ParserState state;
+        helpers::bytebuf commandbuf;
 
         Settings settings;
+        OutputFormat format;
+        Encoder encoder;
+        std::shared_ptr<sbs::Encoder> sbs_encoder;
+
+        // text formats encoded on a pool: messages wait in encode_queue
+        // while a batch is being encoded, so at most one batch is in flight
+        // and output order is preserved
+        helpers::WorkPool *encode_pool;
+        std::vector<modes::Message> encode_queue;
+        bool encode_scheduled;
+        bool encode_in_flight;
+
+        std::unique_ptr<modes::RateLimiter> rate_limiter;
+        std::unique_ptr<modes::ReorderBuffer> reorder;
+        boost::asio::steady_timer reorder_timer;
+        bool reorder_timer_pending;
+
+        // GPS to 12MHz conversion state, to handle the midnight rollover.
+        // With an encode pool, text formats update this on the pool, one
+        // batch at a time.
+        std::uint64_t last_gps_seconds;
+        std::uint64_t gps_days;
 
         std::function<void(const Settings&)> settings_notifier;
         std::function<void()> close_notifier;
 
         std::shared_ptr<helpers::bytebuf> outbuf;
         bool flush_pending;
+
+        // see OutputOptions::queue_limit; dropped counts the messages
+        // dropped since we last kept up
+        std::size_t queue_limit;
+        bool queue_overflowing;
+        std::uint64_t queue_dropped;
+
+        // recycled handler memory for the repeating operations above
+        helpers::HandlerMemory read_memory;
+        helpers::HandlerMemory write_memory;
+        helpers::HandlerMemory post_memory;
+        helpers::HandlerMemory timer_memory;
     };
 
     class SocketListener : public std::enable_shared_from_this<SocketListener> {
@@ -131,19 +285,30 @@ namespace beast {
         static pointer create(boost::asio::io_service &service,
                               const boost::asio::ip::tcp::endpoint &endpoint,
                               modes::FilterDistributor &distributor,
-                              const Settings &initial_settings)
+                              const Settings &initial_settings,
+                              const OutputOptions &options = OutputOptions())
         {
-            return pointer(new SocketListener(service, endpoint, distributor, initial_settings));
+            return pointer(new SocketListener(service, endpoint, distributor, initial_settings, options));
         }
 
         void start();
         void close();
 
+        // handoff support: start on a listening socket inherited from a
+        // previous process, and take over one of its clients
+        void start(int inherited_fd);
+        void adopt(int fd, const Settings &settings);
+
+        int native_handle() { return acceptor.native_handle(); }
+        std::vector<SocketOutput::pointer> connected_outputs() const;
+
     private:
         SocketListener(boost::asio::io_service &service_, const boost::asio::ip::tcp::endpoint &endpoint_,
-                       modes::FilterDistributor &distributor, const Settings &initial_settings_);
+                       modes::FilterDistributor &distributor, const Settings &initial_settings_,
+                       const OutputOptions &options_);
 
         void accept_connection();
+        void new_connection(boost::asio::ip::tcp::socket &&socket, const Settings &settings);
 
         boost::asio::io_service &service;
         boost::asio::ip::tcp::acceptor acceptor;
@@ -152,6 +317,10 @@ namespace beast {
         boost::asio::ip::tcp::endpoint peer;
         modes::FilterDistributor &distributor;
         Settings initial_settings;
+        OutputOptions options;
+
+        // clients accepted here and still connected
+        std::map<modes::FilterDistributor::handle, std::weak_ptr<SocketOutput>> outputs;
     };
 
     class SocketConnector : public std::enable_shared_from_this<SocketConnector> {
@@ -165,26 +334,35 @@ namespace beast {
                               const std::string &host,
                               const std::string &port_or_service,
                               modes::FilterDistributor &distributor,
-                              const Settings &initial_settings)
+                              const Settings &initial_settings,
+                              const OutputOptions &options = OutputOptions())
         {
-            return pointer(new SocketConnector(service, host, port_or_service, distributor, initial_settings));
+            return pointer(new SocketConnector(service, host, port_or_service, distributor, initial_settings, options));
         }
 
         void start();
         void close();
 
+        // handoff support: carry on with a connection inherited from a
+        // previous process instead of start()
+        void adopt(int fd, const Settings &settings);
+
+        SocketOutput::pointer connected_output() const {
+            return output.lock();
+        }
+
     private:
         SocketConnector(boost::asio::io_service &service_,
                         const std::string &host_,
                         const std::string &port_or_service_,
                         modes::FilterDistributor &distributor,
-                        const Settings &initial_settings_);
+                        const Settings &initial_settings_,
+                        const OutputOptions &options_);
 
         void schedule_reconnect();
         void resolve_and_connect(const boost::system::error_code &ec = boost::system::error_code());
         void try_next_endpoint();
-        void connection_established(const boost::asio::ip::tcp::endpoint &endpoint);
-
+        void connection_established(const boost::asio::ip::tcp::endpoint &endpoint, const Settings &settings);
 
         boost::asio::io_service &service;
         boost::asio::ip::tcp::resolver resolver;
@@ -195,9 +373,13 @@ namespace beast {
         std::string port_or_service;
         modes::FilterDistributor &distributor;
         Settings initial_settings;
+        OutputOptions options;
 
         bool running;
         boost::asio::ip::tcp::resolver::iterator next_endpoint;
+
+        // the current connection, if any, so close() can drop it
+        std::weak_ptr<SocketOutput> output;
     };
 };
 
@@ -0,0 +1,168 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/asio.hpp>
+
+#include <cerrno>
+#include <iostream>
+#include <istream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "control_socket.h"
+
+namespace asio = boost::asio;
+using boost::asio::local::stream_protocol;
+
+namespace splitter {
+    void remove_stale_socket(const std::string &path)
+    {
+        struct stat st;
+        if (::lstat(path.c_str(), &st) < 0) {
+            if (errno == ENOENT)
+                return;
+            throw boost::system::system_error(errno, boost::system::system_category(), path);
+        }
+
+        if (!S_ISSOCK(st.st_mode))
+            throw boost::system::system_error(boost::system::errc::make_error_code(boost::system::errc::file_exists),
+                                              path + " is not a socket, not replacing it");
+
+        if (::unlink(path.c_str()) < 0 && errno != ENOENT)
+            throw boost::system::system_error(errno, boost::system::system_category(), path);
+    }
+
+    ControlSocket::ControlSocket(asio::io_service &service_,
+                                 const std::string &path_,
+                                 CommandHandler handler_)
+        : service(service_),
+          acceptor(service_),
+          socket(service_),
+          path(path_),
+          handler(handler_)
+    {
+    }
+
+    void ControlSocket::start()
+    {
+        // a socket left behind by a previous run would make bind fail
+        remove_stale_socket(path);
+
+        stream_protocol::endpoint endpoint(path);
+        acceptor.open(endpoint.protocol());
+        acceptor.bind(endpoint);
+        acceptor.listen();
+        accept_connection();
+    }
+
+    void ControlSocket::close()
+    {
+        acceptor.close();
+        socket.close();
+        ::unlink(path.c_str());
+    }
+
+    void ControlSocket::accept_connection()
+    {
+        auto self(shared_from_this());
+
+        acceptor.async_accept(socket,
+                              [this,self] (const boost::system::error_code &ec) {
+                                  if (!ec) {
+                                      ControlSession::create(std::move(socket), handler)->start();
+                                  } else {
+                                      if (ec == boost::asio::error::operation_aborted)
+                                          return;
+                                      std::cerr << path << ": accept error: " << ec.message() << std::endl;
+                                  }
+
+                                  accept_connection();
+                              });
+    }
+
+    //////////////
+
+    ControlSession::ControlSession(stream_protocol::socket &&socket_,
+                                   ControlSocket::CommandHandler handler_)
+        : socket(std::move(socket_)),
+          handler(handler_),
+          readbuf(max_line_length)
+    {
+    }
+
+    void ControlSession::start()
+    {
+        read_command();
+    }
+
+    void ControlSession::close()
+    {
+        socket.close();
+    }
+
+    void ControlSession::read_command()
+    {
+        auto self(shared_from_this());
+
+        asio::async_read_until(socket, readbuf, '\n',
+                               [this,self] (const boost::system::error_code &ec, std::size_t len) {
+                                   if (ec) {
+                                       // includes EOF and over-long lines
+                                       close();
+                                       return;
+                                   }
+
+                                   std::string line(asio::buffers_begin(readbuf.data()),
+                                                    asio::buffers_begin(readbuf.data()) + len - 1);
+                                   readbuf.consume(len);
+                                   if (!line.empty() && line.back() == '\r')
+                                       line.pop_back();
+
+                                   handle_command(line);
+                               });
+    }
+
+    void ControlSession::handle_command(const std::string &line)
+    {
+        try {
+            reply = handler(line);
+            reply += "ok\n";
+        } catch (const std::exception &err) {
+            reply = std::string("error: ") + err.what() + "\n";
+        }
+
+        auto self(shared_from_this());
+        asio::async_write(socket, asio::buffer(reply),
+                          [this,self] (const boost::system::error_code &ec, std::size_t len) {
+                              if (ec) {
+                                  close();
+                                  return;
+                              }
+
+                              read_command();
+                          });
+    }
+};
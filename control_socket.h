@@ -0,0 +1,112 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONTROL_SOCKET_H
+#define CONTROL_SOCKET_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/streambuf.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace splitter {
+    // Remove a Unix socket left at path by an earlier run, so that bind
+    // can succeed. Anything else at path is left alone and reported by
+    // throwing boost::system::system_error.
+    void remove_stale_socket(const std::string &path);
+
+    // Line-oriented control interface on a Unix domain socket.
+    //
+    // Each line received is passed to the command handler. Whatever it
+    // returns is written back followed by "ok"; if it throws, the reply is
+    // "error: " and the exception text. Connections stay open for any
+    // number of commands.
+    class ControlSocket : public std::enable_shared_from_this<ControlSocket> {
+    public:
+        typedef std::shared_ptr<ControlSocket> pointer;
+        typedef std::function<std::string(const std::string &)> CommandHandler;
+
+        // factory method, this class must always be constructed via make_shared
+        static pointer create(boost::asio::io_service &service,
+                              const std::string &path,
+                              CommandHandler handler)
+        {
+            return pointer(new ControlSocket(service, path, handler));
+        }
+
+        void start();
+        void close();
+
+    private:
+        ControlSocket(boost::asio::io_service &service_,
+                      const std::string &path_,
+                      CommandHandler handler_);
+
+        void accept_connection();
+
+        boost::asio::io_service &service;
+        boost::asio::local::stream_protocol::acceptor acceptor;
+        boost::asio::local::stream_protocol::socket socket;
+        std::string path;
+        CommandHandler handler;
+    };
+
+    class ControlSession : public std::enable_shared_from_this<ControlSession> {
+    public:
+        typedef std::shared_ptr<ControlSession> pointer;
+
+        // longest command line we accept
+        static const std::size_t max_line_length = 4096;
+
+        // factory method, this class must always be constructed via make_shared
+        static pointer create(boost::asio::local::stream_protocol::socket &&socket,
+                              ControlSocket::CommandHandler handler)
+        {
+            return pointer(new ControlSession(std::move(socket), handler));
+        }
+
+        void start();
+        void close();
+
+    private:
+        ControlSession(boost::asio::local::stream_protocol::socket &&socket_,
+                       ControlSocket::CommandHandler handler_);
+
+        void read_command();
+        void handle_command(const std::string &line);
+
+        boost::asio::local::stream_protocol::socket socket;
+        ControlSocket::CommandHandler handler;
+        boost::asio::streambuf readbuf;
+        std::string reply;
+    };
+};
+
+#endif
@@ -0,0 +1,486 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <stdexcept>
+
+#include "cpu_dispatch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || defined(__ARM_NEON)
+#define HAVE_NEON_KERNELS
+#include <arm_neon.h>
+#endif
+
+namespace helpers {
+    //
+    // Scalar
+    //
+
+    static std::size_t find_escape_scalar(const std::uint8_t *p, std::size_t n)
+    {
+        std::size_t i = 0;
+        while (i < n && p[i] != 0x1A)
+            ++i;
+        return i;
+    }
+
+    static void hex_encode_scalar(const std::uint8_t *p, std::size_t n, char *out, bool upper)
+    {
+        const char *hexdigits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+        for (std::size_t i = 0; i < n; ++i) {
+            *out++ = hexdigits[p[i] >> 4];
+            *out++ = hexdigits[p[i] & 0x0F];
+        }
+    }
+
+    // sets the bits for [from,n); the caller clears matches first
+    static inline void match_masks_range(std::size_t from, std::size_t n,
+                                         const std::uint64_t *accept,
+                                         const std::uint64_t *reject,
+                                         const std::uint64_t *reject2,
+                                         std::uint64_t key,
+                                         std::uint64_t key2,
+                                         std::uint64_t *matches)
+    {
+        for (std::size_t i = from; i < n; ++i) {
+            if ((key & accept[i]) && !(key & reject[i]) && !(key2 & reject2[i]))
+                matches[i / 64] |= 1ULL << (i % 64);
+        }
+    }
+
+    static void match_masks_scalar(std::size_t n,
+                                   const std::uint64_t *accept,
+                                   const std::uint64_t *reject,
+                                   const std::uint64_t *reject2,
+                                   std::uint64_t key,
+                                   std::uint64_t key2,
+                                   std::uint64_t *matches)
+    {
+        std::memset(matches, 0, (n + 63) / 64 * sizeof(*matches));
+        match_masks_range(0, n, accept, reject, reject2, key, key2, matches);
+    }
+
+    //
+    // x86. Each function is compiled for its own instruction set via the
+    // target attribute, and only called once the CPU is known to have it.
+    //
+
+#ifdef HAVE_X86_KERNELS
+    __attribute__((target("sse2")))
+    static std::size_t find_escape_sse2(const std::uint8_t *p, std::size_t n)
+    {
+        const __m128i escape = _mm_set1_epi8(0x1A);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+            unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, escape));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+        return i + find_escape_scalar(p + i, n - i);
+    }
+
+    __attribute__((target("avx2")))
+    static std::size_t find_escape_avx2(const std::uint8_t *p, std::size_t n)
+    {
+        const __m256i escape = _mm256_set1_epi8(0x1A);
+        std::size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+            unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, escape));
+            if (mask)
+                return i + __builtin_ctz(mask);
+        }
+        return i + find_escape_sse2(p + i, n - i);
+    }
+
+    __attribute__((target("avx512f,avx512bw")))
+    static std::size_t find_escape_avx512(const std::uint8_t *p, std::size_t n)
+    {
+        const __m512i escape = _mm512_set1_epi8(0x1A);
+        std::size_t i = 0;
+        for (; i + 64 <= n; i += 64) {
+            __m512i v = _mm512_loadu_si512((const void *) (p + i));
+            std::uint64_t mask = _mm512_cmpeq_epi8_mask(v, escape);
+            if (mask)
+                return i + __builtin_ctzll(mask);
+        }
+
+        // masked-off lanes are never read, so the tail needs no scalar loop
+        if (i < n) {
+            __mmask64 valid = ~0ULL >> (64 - (n - i));
+            __m512i v = _mm512_maskz_loadu_epi8(valid, (const void *) (p + i));
+            std::uint64_t mask = _mm512_mask_cmpeq_epi8_mask(valid, v, escape);
+            if (mask)
+                return i + __builtin_ctzll(mask);
+        }
+        return n;
+    }
+
+    // one bit per 64-bit lane, set if the lane is nonzero; SSE2 has no
+    // 64-bit compare, so AND together the two 32-bit halves' results
+    __attribute__((target("sse2")))
+    static inline unsigned nonzero_lanes_sse2(__m128i v)
+    {
+        __m128i zero32 = _mm_cmpeq_epi32(v, _mm_setzero_si128());
+        __m128i zero64 = _mm_and_si128(zero32, _mm_shuffle_epi32(zero32, _MM_SHUFFLE(2, 3, 0, 1)));
+        return ~_mm_movemask_pd(_mm_castsi128_pd(zero64)) & 0x3;
+    }
+
+    __attribute__((target("sse2")))
+    static void match_masks_sse2(std::size_t n,
+                                 const std::uint64_t *accept,
+                                 const std::uint64_t *reject,
+                                 const std::uint64_t *reject2,
+                                 std::uint64_t key,
+                                 std::uint64_t key2,
+                                 std::uint64_t *matches)
+    {
+        std::memset(matches, 0, (n + 63) / 64 * sizeof(*matches));
+
+        const __m128i k = _mm_set1_epi64x(key);
+        const __m128i k2 = _mm_set1_epi64x(key2);
+        std::size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            __m128i a = _mm_and_si128(k, _mm_loadu_si128((const __m128i *) (accept + i)));
+            __m128i r = _mm_or_si128(_mm_and_si128(k, _mm_loadu_si128((const __m128i *) (reject + i))),
+                                     _mm_and_si128(k2, _mm_loadu_si128((const __m128i *) (reject2 + i))));
+            std::uint64_t bits = nonzero_lanes_sse2(a) & ~nonzero_lanes_sse2(r);
+            matches[i / 64] |= bits << (i % 64);
+        }
+        match_masks_range(i, n, accept, reject, reject2, key, key2, matches);
+    }
+
+    __attribute__((target("avx2")))
+    static void match_masks_avx2(std::size_t n,
+                                 const std::uint64_t *accept,
+                                 const std::uint64_t *reject,
+                                 const std::uint64_t *reject2,
+                                 std::uint64_t key,
+                                 std::uint64_t key2,
+                                 std::uint64_t *matches)
+    {
+        std::memset(matches, 0, (n + 63) / 64 * sizeof(*matches));
+
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i k = _mm256_set1_epi64x(key);
+        const __m256i k2 = _mm256_set1_epi64x(key2);
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i a = _mm256_and_si256(k, _mm256_loadu_si256((const __m256i *) (accept + i)));
+            __m256i r = _mm256_or_si256(_mm256_and_si256(k, _mm256_loadu_si256((const __m256i *) (reject + i))),
+                                        _mm256_and_si256(k2, _mm256_loadu_si256((const __m256i *) (reject2 + i))));
+            unsigned a_zero = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(a, zero)));
+            unsigned r_zero = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(r, zero)));
+            std::uint64_t bits = ~a_zero & r_zero & 0xF;
+            matches[i / 64] |= bits << (i % 64);
+        }
+        match_masks_range(i, n, accept, reject, reject2, key, key2, matches);
+    }
+
+    __attribute__((target("avx512f")))
+    static void match_masks_avx512(std::size_t n,
+                                   const std::uint64_t *accept,
+                                   const std::uint64_t *reject,
+                                   const std::uint64_t *reject2,
+                                   std::uint64_t key,
+                                   std::uint64_t key2,
+                                   std::uint64_t *matches)
+    {
+        std::memset(matches, 0, (n + 63) / 64 * sizeof(*matches));
+
+        const __m512i k = _mm512_set1_epi64(key);
+        const __m512i k2 = _mm512_set1_epi64(key2);
+        for (std::size_t i = 0; i < n; i += 8) {
+            // masked-off lanes are never read and compare as no match
+            __mmask8 valid = (n - i >= 8 ? 0xFF : (1U << (n - i)) - 1);
+            __mmask8 a = _mm512_mask_test_epi64_mask(valid, k, _mm512_maskz_loadu_epi64(valid, accept + i));
+            __mmask8 r = _mm512_mask_test_epi64_mask(valid, k, _mm512_maskz_loadu_epi64(valid, reject + i));
+            __mmask8 r2 = _mm512_mask_test_epi64_mask(valid, k2, _mm512_maskz_loadu_epi64(valid, reject2 + i));
+            std::uint64_t bits = (std::uint8_t) (a & ~(r | r2));
+            matches[i / 64] |= bits << (i % 64);
+        }
+    }
+
+    // 16 nibbles (0-15) to hex digits
+    __attribute__((target("sse2")))
+    static inline __m128i nibbles_to_hex_sse2(__m128i v, bool upper)
+    {
+        __m128i letters = _mm_cmpgt_epi8(v, _mm_set1_epi8(9));
+        v = _mm_add_epi8(v, _mm_set1_epi8('0'));
+        return _mm_add_epi8(v, _mm_and_si128(letters, _mm_set1_epi8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10)));
+    }
+
+    __attribute__((target("sse2")))
+    static void hex_encode_sse2(const std::uint8_t *p, std::size_t n, char *out, bool upper)
+    {
+        const __m128i low_nibble = _mm_set1_epi8(0x0F);
+        while (n > 0) {
+            // messages are shorter than a vector, so go via a zero-padded
+            // copy rather than reading past the end of the data
+            std::size_t chunk = (n < 16 ? n : 16);
+            __m128i v;
+            if (chunk == 16) {
+                v = _mm_loadu_si128((const __m128i *) p);
+            } else {
+                alignas(16) std::uint8_t padded[16] = { 0 };
+                std::memcpy(padded, p, chunk);
+                v = _mm_load_si128((const __m128i *) padded);
+            }
+
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+            __m128i lo = _mm_and_si128(v, low_nibble);
+            __m128i first = nibbles_to_hex_sse2(_mm_unpacklo_epi8(hi, lo), upper);
+            __m128i second = nibbles_to_hex_sse2(_mm_unpackhi_epi8(hi, lo), upper);
+
+            if (chunk == 16) {
+                _mm_storeu_si128((__m128i *) out, first);
+                _mm_storeu_si128((__m128i *) (out + 16), second);
+            } else {
+                alignas(16) char digits[32];
+                _mm_store_si128((__m128i *) digits, first);
+                _mm_store_si128((__m128i *) (digits + 16), second);
+                std::memcpy(out, digits, chunk * 2);
+            }
+
+            p += chunk;
+            out += chunk * 2;
+            n -= chunk;
+        }
+    }
+#endif
+
+    //
+    // ARM
+    //
+
+#ifdef HAVE_NEON_KERNELS
+    static std::size_t find_escape_neon(const std::uint8_t *p, std::size_t n)
+    {
+        const uint8x16_t escape = vdupq_n_u8(0x1A);
+        std::size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            uint8x16_t eq = vceqq_u8(vld1q_u8(p + i), escape);
+            // narrow each byte's result to 4 bits of a 64-bit mask
+            std::uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+            if (mask)
+                return i + (__builtin_ctzll(mask) >> 2);
+        }
+        return i + find_escape_scalar(p + i, n - i);
+    }
+
+    // all-ones in each 64-bit lane where (a & b) != 0. vtstq_u64 is
+    // AArch64 only, so test the 32-bit halves and merge them.
+    static inline uint64x2_t test_lanes_neon(uint64x2_t a, uint64x2_t b)
+    {
+        uint32x4_t t = vtstq_u32(vreinterpretq_u32_u64(a), vreinterpretq_u32_u64(b));
+        return vreinterpretq_u64_u32(vorrq_u32(t, vrev64q_u32(t)));
+    }
+
+    static void match_masks_neon(std::size_t n,
+                                 const std::uint64_t *accept,
+                                 const std::uint64_t *reject,
+                                 const std::uint64_t *reject2,
+                                 std::uint64_t key,
+                                 std::uint64_t key2,
+                                 std::uint64_t *matches)
+    {
+        std::memset(matches, 0, (n + 63) / 64 * sizeof(*matches));
+
+        const uint64x2_t k = vdupq_n_u64(key);
+        const uint64x2_t k2 = vdupq_n_u64(key2);
+        std::size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+            uint64x2_t a = test_lanes_neon(k, vld1q_u64(accept + i));
+            uint64x2_t r = vorrq_u64(test_lanes_neon(k, vld1q_u64(reject + i)),
+                                     test_lanes_neon(k2, vld1q_u64(reject2 + i)));
+            uint64x2_t hit = vbicq_u64(a, r);
+            std::uint64_t bits = (vgetq_lane_u64(hit, 0) & 1) | (vgetq_lane_u64(hit, 1) & 2);
+            matches[i / 64] |= bits << (i % 64);
+        }
+        match_masks_range(i, n, accept, reject, reject2, key, key2, matches);
+    }
+
+    static inline uint8x16_t nibbles_to_hex_neon(uint8x16_t v, bool upper)
+    {
+        uint8x16_t letters = vcgtq_u8(v, vdupq_n_u8(9));
+        v = vaddq_u8(v, vdupq_n_u8('0'));
+        return vaddq_u8(v, vandq_u8(letters, vdupq_n_u8(upper ? 'A' - '0' - 10 : 'a' - '0' - 10)));
+    }
+
+    static void hex_encode_neon(const std::uint8_t *p, std::size_t n, char *out, bool upper)
+    {
+        while (n > 0) {
+            std::size_t chunk = (n < 16 ? n : 16);
+            uint8x16_t v;
+            if (chunk == 16) {
+                v = vld1q_u8(p);
+            } else {
+                std::uint8_t padded[16] = { 0 };
+                std::memcpy(padded, p, chunk);
+                v = vld1q_u8(padded);
+            }
+
+            uint8x16x2_t digits = vzipq_u8(nibbles_to_hex_neon(vshrq_n_u8(v, 4), upper),
+                                           nibbles_to_hex_neon(vandq_u8(v, vdupq_n_u8(0x0F)), upper));
+            if (chunk == 16) {
+                vst1q_u8((std::uint8_t *) out, digits.val[0]);
+                vst1q_u8((std::uint8_t *) out + 16, digits.val[1]);
+            } else {
+                std::uint8_t tmp[32];
+                vst1q_u8(tmp, digits.val[0]);
+                vst1q_u8(tmp + 16, digits.val[1]);
+                std::memcpy(out, tmp, chunk * 2);
+            }
+
+            p += chunk;
+            out += chunk * 2;
+            n -= chunk;
+        }
+    }
+#endif
+
+    //
+    // Selection
+    //
+
+    Kernels kernels = {
+        find_escape_scalar,
+        hex_encode_scalar,
+        match_masks_scalar
+    };
+
+    static SimdLevel selected = SimdLevel::SCALAR;
+
+    bool simd_level_supported(SimdLevel level)
+    {
+        switch (level) {
+        case SimdLevel::SCALAR:
+            return true;
+#ifdef HAVE_X86_KERNELS
+        case SimdLevel::SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case SimdLevel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+        case SimdLevel::AVX512:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+#ifdef HAVE_NEON_KERNELS
+        case SimdLevel::NEON:
+            // either AArch64, where it is always there, or a 32-bit build
+            // that was already told to assume it
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    SimdLevel detect_simd_level()
+    {
+        for (auto level : { SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::SSE2, SimdLevel::NEON }) {
+            if (simd_level_supported(level))
+                return level;
+        }
+        return SimdLevel::SCALAR;
+    }
+
+    void select_kernels(SimdLevel level)
+    {
+        if (!simd_level_supported(level))
+            throw std::runtime_error(std::string("this CPU does not support ") + simd_level_name(level));
+
+        kernels.find_escape = find_escape_scalar;
+        kernels.hex_encode = hex_encode_scalar;
+        kernels.match_masks = match_masks_scalar;
+
+        switch (level) {
+#ifdef HAVE_X86_KERNELS
+        case SimdLevel::AVX512:
+            kernels.find_escape = find_escape_avx512;
+            kernels.hex_encode = hex_encode_sse2;
+            kernels.match_masks = match_masks_avx512;
+            break;
+        case SimdLevel::AVX2:
+            kernels.find_escape = find_escape_avx2;
+            kernels.hex_encode = hex_encode_sse2;
+            kernels.match_masks = match_masks_avx2;
+            break;
+        case SimdLevel::SSE2:
+            kernels.find_escape = find_escape_sse2;
+            kernels.hex_encode = hex_encode_sse2;
+            kernels.match_masks = match_masks_sse2;
+            break;
+#endif
+#ifdef HAVE_NEON_KERNELS
+        case SimdLevel::NEON:
+            kernels.find_escape = find_escape_neon;
+            kernels.hex_encode = hex_encode_neon;
+            kernels.match_masks = match_masks_neon;
+            break;
+#endif
+        default:
+            break;
+        }
+
+        selected = level;
+    }
+
+    SimdLevel selected_simd_level()
+    {
+        return selected;
+    }
+
+    const char *simd_level_name(SimdLevel level)
+    {
+        switch (level) {
+        case SimdLevel::SCALAR: return "scalar";
+        case SimdLevel::SSE2: return "sse2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::NEON: return "neon";
+        default: return "unknown";
+        }
+    }
+
+    bool parse_simd_level(const std::string &name, SimdLevel &level)
+    {
+        for (auto l : { SimdLevel::SCALAR, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512, SimdLevel::NEON }) {
+            if (name == simd_level_name(l)) {
+                level = l;
+                return true;
+            }
+        }
+        return false;
+    }
+};
@@ -0,0 +1,87 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace helpers {
+    // Instruction sets the hot loops have implementations for. The
+    // x86 levels are in order of preference; NEON is the ARM equivalent.
+    enum class SimdLevel {
+        SCALAR,
+        SSE2,
+        AVX2,
+        AVX512,
+        NEON
+    };
+
+    // The hot loops, each implemented for several instruction sets. The
+    // table starts out scalar; select_kernels() points each entry at the
+    // best implementation the chosen level allows. The build never assumes
+    // more than the baseline instruction set, so one binary runs anywhere.
+    struct Kernels {
+        // offset of the first 0x1A in p[0..n), or n if there is none
+        std::size_t (*find_escape)(const std::uint8_t *p, std::size_t n);
+
+        // write two hex digits for each byte of p[0..n) to out
+        void (*hex_encode)(const std::uint8_t *p, std::size_t n, char *out, bool upper);
+
+        // For each i in [0,n), set bit i%64 of matches[i/64] if
+        // (key & accept[i]) != 0, (key & reject[i]) == 0 and
+        // (key2 & reject2[i]) == 0, else clear it. matches must have room
+        // for (n+63)/64 words.
+        void (*match_masks)(std::size_t n,
+                            const std::uint64_t *accept,
+                            const std::uint64_t *reject,
+                            const std::uint64_t *reject2,
+                            std::uint64_t key,
+                            std::uint64_t key2,
+                            std::uint64_t *matches);
+    };
+
+    extern Kernels kernels;
+
+    // the best level this CPU supports
+    SimdLevel detect_simd_level();
+    bool simd_level_supported(SimdLevel level);
+
+    // Must be called before any other threads start. Throws
+    // std::runtime_error if the CPU doesn't support the level.
+    void select_kernels(SimdLevel level);
+    SimdLevel selected_simd_level();
+
+    const char *simd_level_name(SimdLevel level);
+    // false if the name isn't recognized
+    bool parse_simd_level(const std::string &name, SimdLevel &level);
+};
+
+#endif
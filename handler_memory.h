@@ -0,0 +1,130 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef HANDLER_MEMORY_H
+#define HANDLER_MEMORY_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace helpers {
+    // A block of memory reused for the handler of one repeating
+    // asynchronous operation (a read loop, a write, a timer), along the
+    // lines of asio's custom allocation example.
+    //
+    // asio frees an operation's memory before calling its handler, so a
+    // loop that starts the next operation from the handler always finds the
+    // block free again and steady-state I/O doesn't allocate. If the block
+    // is busy or too small we fall back to the heap.
+    class HandlerMemory {
+    public:
+        HandlerMemory() : in_use(false) {}
+
+        HandlerMemory(const HandlerMemory &) = delete;
+        HandlerMemory &operator=(const HandlerMemory &) = delete;
+
+        void *allocate(std::size_t size) {
+            if (!in_use && size <= sizeof(storage)) {
+                in_use = true;
+                return &storage;
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate(void *p) {
+            if (p == &storage)
+                in_use = false;
+            else
+                ::operator delete(p);
+        }
+
+    private:
+        typename std::aligned_storage<512>::type storage;
+        bool in_use;
+    };
+
+    // the allocator asio finds via a handler's get_allocator()
+    template <class T> class HandlerAllocator {
+    public:
+        typedef T value_type;
+
+        explicit HandlerAllocator(HandlerMemory &memory_) : memory(memory_) {}
+
+        template <class U> HandlerAllocator(const HandlerAllocator<U> &other) : memory(other.memory) {}
+
+        T *allocate(std::size_t n) const {
+            return static_cast<T*>(memory.allocate(sizeof(T) * n));
+        }
+
+        void deallocate(T *p, std::size_t) const {
+            memory.deallocate(p);
+        }
+
+        bool operator==(const HandlerAllocator &other) const {
+            return &memory == &other.memory;
+        }
+
+        bool operator!=(const HandlerAllocator &other) const {
+            return &memory != &other.memory;
+        }
+
+    private:
+        template <class> friend class HandlerAllocator;
+        HandlerMemory &memory;
+    };
+
+    // wraps a handler so that asio allocates its operation from 'memory'
+    template <class Handler> class RecyclingHandler {
+    public:
+        typedef HandlerAllocator<Handler> allocator_type;
+
+        RecyclingHandler(HandlerMemory &memory_, Handler handler_)
+            : memory(memory_), handler(std::move(handler_)) {}
+
+        allocator_type get_allocator() const {
+            return allocator_type(memory);
+        }
+
+        template <class... Args> void operator()(Args&&... args) {
+            handler(std::forward<Args>(args)...);
+        }
+
+    private:
+        HandlerMemory &memory;
+        Handler handler;
+    };
+
+    template <class Handler>
+    inline RecyclingHandler<typename std::decay<Handler>::type> recycle(HandlerMemory &memory, Handler &&handler) {
+        return RecyclingHandler<typename std::decay<Handler>::type>(memory, std::forward<Handler>(handler));
+    }
+};
+
+#endif
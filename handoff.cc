@@ -0,0 +1,223 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/asio.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "control_socket.h"
+#include "handoff.h"
+
+namespace asio = boost::asio;
+
+namespace splitter {
+    // longest description we send or accept
+    static const std::size_t max_description = 4096;
+
+    static boost::system::system_error errno_error(const char *what)
+    {
+        return boost::system::system_error(boost::system::error_code(errno, boost::system::system_category()), what);
+    }
+
+    void send_handoff_item(int sock, const HandoffItem &item)
+    {
+        if (item.description.empty() || item.description.size() > max_description)
+            throw boost::system::system_error(boost::asio::error::message_size, "handoff");
+
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(item.description.data());
+        iov.iov_len = item.description.size();
+
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } control;
+
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        if (item.fd >= 0) {
+            std::memset(&control, 0, sizeof(control));
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            std::memcpy(CMSG_DATA(cmsg), &item.fd, sizeof(int));
+        }
+
+        if (::sendmsg(sock, &msg, MSG_NOSIGNAL) < 0)
+            throw errno_error("handoff sendmsg");
+    }
+
+    static void close_items(std::vector<HandoffItem> &items)
+    {
+        for (auto &item : items) {
+            if (item.fd >= 0)
+                ::close(item.fd);
+        }
+        items.clear();
+    }
+
+    std::vector<HandoffItem> receive_handoff(const std::string &path)
+    {
+        std::vector<HandoffItem> items;
+
+        struct sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            throw boost::system::system_error(boost::asio::error::name_too_long, "handoff path");
+        std::memcpy(addr.sun_path, path.data(), path.size());
+
+        int sock = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (sock < 0)
+            throw errno_error("handoff socket");
+
+        if (::connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+            // nobody to take over from (or a socket left by a dead process)
+            ::close(sock);
+            return items;
+        }
+
+        // the old process drains its clients before sending anything,
+        // but don't wait forever on one that has wedged
+        struct timeval timeout = { 10, 0 };
+        ::setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        for (;;) {
+            char buf[max_description];
+            struct iovec iov;
+            iov.iov_base = buf;
+            iov.iov_len = sizeof(buf);
+
+            union {
+                struct cmsghdr align;
+                char buf[CMSG_SPACE(sizeof(int))];
+            } control;
+
+            struct msghdr msg;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.buf;
+            msg.msg_controllen = sizeof(control.buf);
+
+            ssize_t n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+            if (n <= 0) {
+                auto err = (n < 0 ? errno_error("handoff recvmsg") :
+                            boost::system::system_error(boost::asio::error::connection_aborted, "handoff ended early"));
+                close_items(items);
+                ::close(sock);
+                throw err;
+            }
+
+            HandoffItem item;
+            item.description.assign(buf, n);
+            item.fd = -1;
+
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int)))
+                    std::memcpy(&item.fd, CMSG_DATA(cmsg), sizeof(int));
+            }
+
+            if (item.description == "end")
+                break;
+
+            items.push_back(item);
+        }
+
+        ::close(sock);
+        return items;
+    }
+
+    //////////////
+
+    HandoffServer::HandoffServer(asio::io_service &service_,
+                                 const std::string &path_,
+                                 ConnectHandler handler_)
+        : acceptor(service_),
+          socket(service_),
+          path(path_),
+          handler(handler_)
+    {
+    }
+
+    void HandoffServer::start()
+    {
+        // the socket of the process we took over from (if any) is still
+        // bound here until it exits
+        remove_stale_socket(path);
+
+        asio::local::stream_protocol::endpoint local(path);
+        asio::generic::seq_packet_protocol::endpoint endpoint(local);
+        acceptor.open(endpoint.protocol());
+        acceptor.bind(endpoint);
+        acceptor.listen();
+        accept_connection();
+    }
+
+    void HandoffServer::close()
+    {
+        acceptor.close();
+        socket.close();
+    }
+
+    void HandoffServer::accept_connection()
+    {
+        auto self(shared_from_this());
+
+        acceptor.async_accept(socket,
+                              [this,self] (const boost::system::error_code &ec) {
+                                  if (!ec) {
+                                      // the handler sends with plain blocking calls
+                                      int fd = ::fcntl(socket.native_handle(), F_DUPFD_CLOEXEC, 0);
+                                      socket.close();
+                                      if (fd >= 0) {
+                                          ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+                                          handler(fd);
+                                      }
+                                  } else {
+                                      if (ec == boost::asio::error::operation_aborted)
+                                          return;
+                                      std::cerr << path << ": accept error: " << ec.message() << std::endl;
+                                  }
+
+                                  accept_connection();
+                              });
+    }
+};
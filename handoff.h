@@ -0,0 +1,94 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/generic/seq_packet_protocol.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace splitter {
+    // Handing live connections from a running beast-splitter to its
+    // replacement, so an upgrade doesn't drop the receiver or any clients.
+    //
+    // The old process listens on a SOCK_SEQPACKET Unix socket. The new
+    // process connects to it and receives a series of items, each a line of
+    // text describing some state plus at most one file descriptor (passed
+    // with SCM_RIGHTS), ending with an item reading "end".
+
+    struct HandoffItem {
+        std::string description;
+        int fd;     // -1 if none
+    };
+
+    // Send one item on a connected handoff socket; throws
+    // boost::system::system_error on failure.
+    void send_handoff_item(int sock, const HandoffItem &item);
+
+    // Connect to the process listening on path and receive everything it
+    // hands over. Returns an empty list if nothing is listening there.
+    // Throws boost::system::system_error if the transfer fails part way.
+    std::vector<HandoffItem> receive_handoff(const std::string &path);
+
+    // Listens for a replacement process and passes the connected socket
+    // to the handler, which then owns it.
+    class HandoffServer : public std::enable_shared_from_this<HandoffServer> {
+    public:
+        typedef std::shared_ptr<HandoffServer> pointer;
+        typedef std::function<void(int)> ConnectHandler;
+
+        // factory method, this class must always be constructed via make_shared
+        static pointer create(boost::asio::io_service &service,
+                              const std::string &path,
+                              ConnectHandler handler)
+        {
+            return pointer(new HandoffServer(service, path, handler));
+        }
+
+        void start();
+        void close();
+
+    private:
+        HandoffServer(boost::asio::io_service &service_,
+                      const std::string &path_,
+                      ConnectHandler handler_);
+
+        void accept_connection();
+
+        boost::asio::basic_socket_acceptor<boost::asio::generic::seq_packet_protocol> acceptor;
+        boost::asio::generic::seq_packet_protocol::socket socket;
+        std::string path;
+        ConnectHandler handler;
+    };
+};
+
+#endif
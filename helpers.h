@@ -28,11 +28,119 @@
 #ifndef HELPERS_H
 #define HELPERS_H
 
+#include <cassert>
 #include <cstdint>
 #include <vector>
 
+#include "cpu_dispatch.h"
+
 namespace helpers {
     typedef std::vector<std::uint8_t> bytebuf;
+
+    // A small fixed-size line buffer with just enough formatting for the
+    // text output formats. Much cheaper than going via an ostream.
+    class TextBuffer {
+    public:
+        static const std::size_t capacity = 256;
+
+        TextBuffer() : len(0) {}
+
+        void clear() { len = 0; }
+        const char *data() const { return buf; }
+        std::size_t size() const { return len; }
+
+        TextBuffer &put(char c) {
+            assert(len < capacity);
+            buf[len++] = c;
+            return *this;
+        }
+
+        TextBuffer &put(const char *s) {
+            while (*s)
+                put(*s++);
+            return *this;
+        }
+
+        TextBuffer &put(const TextBuffer &other) {
+            for (std::size_t i = 0; i < other.len; ++i)
+                put(other.buf[i]);
+            return *this;
+        }
+
+        TextBuffer &put_uint(std::uint64_t v) {
+            char tmp[20];
+            std::size_t n = 0;
+            do {
+                tmp[n++] = (char) ('0' + v % 10);
+                v /= 10;
+            } while (v);
+            while (n)
+                put(tmp[--n]);
+            return *this;
+        }
+
+        TextBuffer &put_int(std::int64_t v) {
+            if (v < 0) {
+                put('-');
+                return put_uint(-(std::uint64_t)v);
+            }
+            return put_uint(v);
+        }
+
+        // zero-padded to at least 'width' digits
+        TextBuffer &put_uint(std::uint64_t v, unsigned width) {
+            char tmp[20];
+            std::size_t n = 0;
+            do {
+                tmp[n++] = (char) ('0' + v % 10);
+                v /= 10;
+            } while (v || n < width);
+            while (n)
+                put(tmp[--n]);
+            return *this;
+        }
+
+        // fixed point with 'decimals' digits after the point, rounded
+        TextBuffer &put_fixed(double v, unsigned decimals) {
+            std::uint64_t scale = 1;
+            for (unsigned i = 0; i < decimals; ++i)
+                scale *= 10;
+
+            if (v < 0) {
+                v = -v;
+                put('-');
+            }
+
+            std::uint64_t scaled = (std::uint64_t) (v * scale + 0.5);
+            put_uint(scaled / scale);
+            if (decimals > 0)
+                put('.').put_uint(scaled % scale, decimals);
+            return *this;
+        }
+
+        // exactly 'digits' hex digits, lowercase unless 'upper' is set
+        TextBuffer &put_hex(std::uint64_t v, unsigned digits, bool upper = false) {
+            const char *hexdigits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+            while (digits)
+                put(hexdigits[(v >> (4 * --digits)) & 0x0F]);
+            return *this;
+        }
+
+        TextBuffer &put_hex(const bytebuf &data) {
+            assert(len + data.size() * 2 <= capacity);
+            kernels.hex_encode(data.data(), data.size(), buf + len, false);
+            len += data.size() * 2;
+            return *this;
+        }
+
+        void append_to(bytebuf &v) const {
+            v.insert(v.end(), buf, buf + len);
+        }
+
+    private:
+        char buf[capacity];
+        std::size_t len;
+    };
 };
 
 #endif
@@ -0,0 +1,161 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Checks each SIMD kernel this CPU can run against the scalar version on
+// random input, for "make check". Exits 1 on the first mismatch.
+//
+// usage: kernel-check [ITERATIONS]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpu_dispatch.h"
+
+using helpers::SimdLevel;
+using helpers::kernels;
+
+static std::mt19937_64 rng(12345);
+
+// Receiver-like data: mostly random, with a varying density of escapes
+static std::vector<std::uint8_t> random_bytes(std::size_t n)
+{
+    std::vector<std::uint8_t> buf(n);
+    unsigned density = rng() % 4;
+    for (auto &b : buf) {
+        b = rng();
+        if (density && rng() % (64 << density) == 0)
+            b = 0x1A;
+        else if (b == 0x1A && density == 0)
+            b = 0;
+    }
+    return buf;
+}
+
+// Mostly-sparse masks, as real filters produce
+static std::uint64_t random_mask()
+{
+    switch (rng() % 4) {
+    case 0:
+        return 0;
+    case 1:
+        return ~0ULL;
+    default:
+        return rng() & rng() & rng();
+    }
+}
+
+static bool check_find_escape(const char *level)
+{
+    std::size_t n = rng() % 300;
+    auto buf = random_bytes(n);
+    // start part way in, to cover unaligned loads
+    std::size_t start = (n ? rng() % (n / 4 + 1) : 0);
+
+    std::size_t got = kernels.find_escape(buf.data() + start, n - start);
+    helpers::select_kernels(SimdLevel::SCALAR);
+    std::size_t want = kernels.find_escape(buf.data() + start, n - start);
+
+    if (got != want) {
+        std::cerr << level << " find_escape: length " << n - start << ": got " << got << ", expected " << want << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool check_hex_encode(const char *level)
+{
+    std::size_t n = rng() % 70;
+    auto buf = random_bytes(n);
+    bool upper = rng() & 1;
+
+    // a guard band after the output catches overruns
+    std::string got(n * 2 + 16, '#'), want(n * 2 + 16, '#');
+    kernels.hex_encode(buf.data(), n, &got[0], upper);
+    helpers::select_kernels(SimdLevel::SCALAR);
+    kernels.hex_encode(buf.data(), n, &want[0], upper);
+
+    if (got != want) {
+        std::cerr << level << " hex_encode: length " << n << (upper ? " upper" : " lower") << ": got " << got << ", expected " << want << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool check_match_masks(const char *level)
+{
+    std::size_t n = rng() % 200;
+    std::vector<std::uint64_t> accept(n), reject(n), reject2(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        accept[i] = random_mask();
+        reject[i] = random_mask();
+        reject2[i] = random_mask() & 0xFFFFFFFF;
+    }
+
+    // one class bit, and usually at most one type code bit, as a Message has
+    std::uint64_t key = 1ULL << (rng() % 64);
+    std::uint64_t key2 = (rng() % 3 ? 0 : 1ULL << (rng() % 32));
+
+    // an extra word, which must be left alone
+    std::vector<std::uint64_t> got((n + 63) / 64 + 1, 0x5A5A5A5A5A5A5A5AULL), want(got);
+    kernels.match_masks(n, accept.data(), reject.data(), reject2.data(), key, key2, got.data());
+    helpers::select_kernels(SimdLevel::SCALAR);
+    kernels.match_masks(n, accept.data(), reject.data(), reject2.data(), key, key2, want.data());
+
+    if (got != want) {
+        std::cerr << level << " match_masks: " << n << " clients: results differ" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = (argc > 1 ? std::atoi(argv[1]) : 20000);
+
+    for (auto level : { SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512, SimdLevel::NEON }) {
+        const char *name = helpers::simd_level_name(level);
+        if (!helpers::simd_level_supported(level)) {
+            std::cout << name << ": not supported here, skipped" << std::endl;
+            continue;
+        }
+
+        for (unsigned i = 0; i < iterations; ++i) {
+            for (auto check : { check_find_escape, check_hex_encode, check_match_masks }) {
+                // each check runs the level under test, then scalar
+                helpers::select_kernels(level);
+                if (!check(name))
+                    return 1;
+            }
+        }
+
+        std::cout << name << ": ok" << std::endl;
+    }
+
+    return 0;
+}
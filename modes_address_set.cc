@@ -0,0 +1,119 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "modes_address_set.h"
+
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+namespace modes {
+    const std::uint32_t AddressSet::empty;
+
+    AddressSet::AddressSet()
+        : slots(16, empty),
+          mask(15),
+          count(0)
+    {
+    }
+
+    void AddressSet::insert(std::uint32_t address)
+    {
+        address &= 0x00FFFFFF;
+        if (contains(address))
+            return;
+
+        if ((count + 1) * 2 > slots.size())
+            rehash(slots.size() * 2);
+
+        std::uint32_t i = address_hash(address) & mask;
+        while (slots[i] != empty)
+            i = (i + 1) & mask;
+
+        slots[i] = address;
+        ++count;
+    }
+
+    void AddressSet::rehash(std::size_t new_size)
+    {
+        std::vector<std::uint32_t> old_slots(new_size, empty);
+        old_slots.swap(slots);
+        mask = new_size - 1;
+
+        for (auto address : old_slots) {
+            if (address == empty)
+                continue;
+
+            std::uint32_t i = address_hash(address) & mask;
+            while (slots[i] != empty)
+                i = (i + 1) & mask;
+            slots[i] = address;
+        }
+    }
+
+    AddressSet AddressSet::from_file(const std::string &path)
+    {
+        std::ifstream inf(path);
+        if (!inf)
+            throw std::runtime_error(path + ": could not open address list");
+
+        AddressSet set;
+        std::string line;
+        unsigned lineno = 0;
+        while (std::getline(inf, line)) {
+            ++lineno;
+
+            auto comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+
+            std::size_t i = 0;
+            while (i < line.size()) {
+                if (std::isspace((unsigned char)line[i]) || line[i] == ',') {
+                    ++i;
+                    continue;
+                }
+
+                std::uint32_t address = 0;
+                std::size_t digits = 0;
+                for (; i < line.size() && std::isxdigit((unsigned char)line[i]); ++i, ++digits) {
+                    char ch = std::tolower((unsigned char)line[i]);
+                    address = (address << 4) | (ch <= '9' ? ch - '0' : ch - 'a' + 10);
+                }
+
+                if (digits == 0 || digits > 6 || (i < line.size() && !std::isspace((unsigned char)line[i]) && line[i] != ',')) {
+                    throw std::runtime_error(path + ":" + std::to_string(lineno) + ": bad ICAO address");
+                }
+
+                set.insert(address);
+            }
+        }
+
+        if (inf.bad())
+            throw std::runtime_error(path + ": error reading address list");
+
+        return set;
+    }
+};
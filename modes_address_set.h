@@ -0,0 +1,83 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODES_ADDRESS_SET_H
+#define MODES_ADDRESS_SET_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace modes {
+    // hash function for tables keyed by 24-bit ICAO address
+    inline std::uint32_t address_hash(std::uint32_t address) {
+        std::uint32_t h = address * 0x9E3779B1U;
+        return h ^ (h >> 16);
+    }
+
+    // A set of 24-bit ICAO addresses.
+    //
+    // This is an open-addressing hash table with linear probing, kept at
+    // most half full, so a lookup is usually a single probe into a small
+    // contiguous array. Sets are built once when an output is configured
+    // and then only queried.
+    class AddressSet {
+    public:
+        AddressSet();
+
+        // read a set of addresses from a file: hex addresses separated by
+        // whitespace or commas, with '#' starting a comment.
+        // throws std::runtime_error if the file can't be read or parsed
+        static AddressSet from_file(const std::string &path);
+
+        void insert(std::uint32_t address);
+
+        bool contains(std::uint32_t address) const {
+            for (std::uint32_t i = address_hash(address) & mask; ; i = (i + 1) & mask) {
+                if (slots[i] == address)
+                    return true;
+                if (slots[i] == empty)
+                    return false;
+            }
+        }
+
+        std::size_t size() const {
+            return count;
+        }
+
+    private:
+        static const std::uint32_t empty = 0xFFFFFFFF;
+
+        void rehash(std::size_t new_size);
+
+        std::vector<std::uint32_t> slots;
+        std::uint32_t mask;
+        std::size_t count;
+    };
+};
+
+#endif
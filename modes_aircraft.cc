@@ -0,0 +1,202 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "modes_aircraft.h"
+#include "modes_address_set.h"
+
+namespace modes {
+    const std::uint32_t AircraftTable::empty;
+
+    AircraftTable::AircraftTable()
+        : keys(1024, empty),
+          aircraft(1024),
+          mask(1023),
+          count(0),
+          interval_start(clock::now()),
+          interval_messages(0),
+          interval_signal(0)
+    {
+        interval_df.fill(0);
+    }
+
+    std::size_t AircraftTable::lookup(std::uint32_t address) const
+    {
+        std::uint32_t i = address_hash(address) & mask;
+        while (keys[i] != address && keys[i] != empty)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    const Aircraft *AircraftTable::find(std::uint32_t address) const
+    {
+        std::size_t i = lookup(address);
+        return (keys[i] == empty ? nullptr : &aircraft[i]);
+    }
+
+    Aircraft &AircraftTable::insert(std::uint32_t address)
+    {
+        if ((count + 1) * 2 > keys.size())
+            rehash(keys.size() * 2);
+
+        std::size_t i = lookup(address);
+        keys[i] = address;
+        ++count;
+
+        Aircraft &a = aircraft[i];
+        a.address = address;
+        a.last_seen = clock::time_point();
+        a.last_position = clock::time_point();
+        a.messages = 0;
+        a.df_messages.fill(0);
+        a.signal_sum = 0;
+        a.signal_max = 0;
+        return a;
+    }
+
+    void AircraftTable::erase(std::size_t i)
+    {
+        // backward-shift deletion, so we never need tombstones
+        std::size_t j = i;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (keys[j] == empty)
+                break;
+
+            // can the entry at j move back to i? only if its home slot
+            // does not lie cyclically within (i, j]
+            std::size_t home = address_hash(keys[j]) & mask;
+            bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stays) {
+                keys[i] = keys[j];
+                aircraft[i] = aircraft[j];
+                i = j;
+            }
+        }
+
+        keys[i] = empty;
+        --count;
+    }
+
+    void AircraftTable::rehash(std::size_t new_size)
+    {
+        std::vector<std::uint32_t> old_keys(new_size, empty);
+        std::vector<Aircraft> old_aircraft(new_size);
+        old_keys.swap(keys);
+        old_aircraft.swap(aircraft);
+        mask = new_size - 1;
+
+        for (std::size_t j = 0; j < old_keys.size(); ++j) {
+            if (old_keys[j] == empty)
+                continue;
+
+            std::size_t i = lookup(old_keys[j]);
+            keys[i] = old_keys[j];
+            aircraft[i] = old_aircraft[j];
+        }
+    }
+
+    void AircraftTable::update(const Message &message)
+    {
+        int address = message.address();
+        if (address < 0)
+            return;
+
+        int df = message.df();
+        std::size_t i = lookup(address);
+        Aircraft *a;
+        if (keys[i] != empty) {
+            a = &aircraft[i];
+        } else {
+            // Only DF11/17/18 with a good CRC may create new entries;
+            // addresses recovered from the AP field of other formats
+            // are just as likely to come from a corrupted message.
+            if ((df != 11 && df != 17 && df != 18) || message.crc_bad())
+                return;
+            a = &insert(address);
+        }
+
+        a->last_seen = message.received();
+        ++a->messages;
+        ++a->df_messages[df];
+        a->signal_sum += message.signal();
+        if (message.signal() > a->signal_max)
+            a->signal_max = message.signal();
+
+        int typecode = message.typecode();
+        if ((typecode >= 5 && typecode <= 18) || (typecode >= 20 && typecode <= 22))
+            a->last_position = message.received();
+
+        ++interval_messages;
+        ++interval_df[df];
+        interval_signal += message.signal();
+    }
+
+    void AircraftTable::expire(clock::time_point now)
+    {
+        for (std::size_t i = 0; i < keys.size(); ) {
+            if (keys[i] != empty && (now - aircraft[i].last_seen) > expire_interval) {
+                // erase() may move a later entry into slot i, so look at it again
+                erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    AircraftTable::Summary AircraftTable::summarize(clock::time_point now)
+    {
+        Summary summary;
+        summary.aircraft = 0;
+        summary.with_position = 0;
+
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] == empty)
+                continue;
+
+            const Aircraft &a = aircraft[i];
+            if ((now - a.last_seen) <= current_interval)
+                ++summary.aircraft;
+            if (a.last_position != clock::time_point() && (now - a.last_position) <= current_interval)
+                ++summary.with_position;
+        }
+
+        summary.interval = std::chrono::duration_cast<std::chrono::milliseconds>(now - interval_start);
+        double seconds = summary.interval.count() / 1000.0;
+        if (seconds <= 0)
+            seconds = 1;
+
+        summary.message_rate = interval_messages / seconds;
+        for (std::size_t df = 0; df < interval_df.size(); ++df)
+            summary.df_rate[df] = interval_df[df] / seconds;
+        summary.signal_mean = (interval_messages ? (double)interval_signal / interval_messages : 0.0);
+
+        interval_start = now;
+        interval_messages = 0;
+        interval_df.fill(0);
+        interval_signal = 0;
+
+        return summary;
+    }
+};
@@ -0,0 +1,114 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODES_AIRCRAFT_H
+#define MODES_AIRCRAFT_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "modes_message.h"
+
+namespace modes {
+    // what we know about one aircraft
+    struct Aircraft {
+        std::uint32_t address;
+        std::chrono::steady_clock::time_point last_seen;
+        std::chrono::steady_clock::time_point last_position; // last DF17/18 position, or default-constructed
+        std::uint32_t messages;
+        std::array<std::uint32_t,32> df_messages;
+        std::uint64_t signal_sum;
+        std::uint8_t signal_max;
+    };
+
+    // A table of recently seen aircraft, keyed by ICAO address.
+    //
+    // Keys are kept in their own array, separate from the per-aircraft
+    // state, so a lookup only scans a few cache lines of addresses. The
+    // table uses linear probing and is kept at most half full; it only
+    // allocates when it needs to grow, never per message.
+    class AircraftTable {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        // aircraft not heard from for this long are removed by expire()
+        const std::chrono::milliseconds expire_interval = std::chrono::seconds(300);
+
+        // aircraft heard from (or with positions) this recently are counted as current
+        const std::chrono::milliseconds current_interval = std::chrono::seconds(60);
+
+        struct Summary {
+            unsigned aircraft;              // aircraft seen within current_interval
+            unsigned with_position;         // .. of which had a position within current_interval
+            std::chrono::milliseconds interval; // time covered by the rates below
+            double message_rate;            // messages per second from known aircraft
+            std::array<double,32> df_rate;  // .. by DF
+            double signal_mean;             // mean signal level of those messages
+        };
+
+        AircraftTable();
+
+        // update the table with a received message
+        void update(const Message &message);
+
+        // remove aircraft that have not been heard from recently
+        void expire(clock::time_point now);
+
+        // summarize the table. Rates cover the time since the previous summary.
+        Summary summarize(clock::time_point now);
+
+        // find an aircraft, or nullptr if it is not in the table
+        const Aircraft *find(std::uint32_t address) const;
+
+        std::size_t size() const {
+            return count;
+        }
+
+    private:
+        static const std::uint32_t empty = 0xFFFFFFFF;
+
+        std::size_t lookup(std::uint32_t address) const;
+        Aircraft &insert(std::uint32_t address);
+        void erase(std::size_t i);
+        void rehash(std::size_t new_size);
+
+        std::vector<std::uint32_t> keys;
+        std::vector<Aircraft> aircraft;
+        std::uint32_t mask;
+        std::size_t count;
+
+        // totals since the last summary
+        clock::time_point interval_start;
+        std::uint64_t interval_messages;
+        std::array<std::uint32_t,32> interval_df;
+        std::uint64_t interval_signal;
+    };
+};
+
+#endif
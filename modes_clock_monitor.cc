@@ -0,0 +1,120 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "modes_clock_monitor.h"
+
+namespace modes {
+    ClockMonitor::ClockMonitor()
+        : last_type(TimestampType::UNKNOWN),
+          last_timestamp(0),
+          jump_ticks(0),
+          anchor_ns(0),
+          regressions(0),
+          jumps(0),
+          rollovers(0),
+          interval_regressions(0),
+          interval_jumps(0)
+    {
+    }
+
+    void ClockMonitor::restart(const Message &message)
+    {
+        last_type = message.timestamp_type();
+        last_timestamp = message.timestamp();
+        last_received = message.received();
+
+        anchor_ns = timestamp_to_ns(last_type, last_timestamp);
+        anchor_received = last_received;
+
+        auto threshold_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(jump_threshold).count();
+        switch (last_type) {
+        case TimestampType::GPS:
+            // the raw difference is never smaller than the step in ns
+            // (crossing a second boundary adds 2^30 - 10^9), so this may
+            // flag a few steps for a closer look but won't miss any
+            jump_ticks = threshold_ns;
+            break;
+        case TimestampType::TWELVEMEG:
+            jump_ticks = threshold_ns * 12 / 1000;
+            break;
+        default:
+            jump_ticks = ~0ULL;
+            break;
+        }
+    }
+
+    void ClockMonitor::step_backwards(const Message &message)
+    {
+        if (last_type == TimestampType::GPS && (last_timestamp >> 30) >= 86390 && (message.timestamp() >> 30) < 10) {
+            // midnight rollover; restart the drift baseline from here
+            ++rollovers;
+        } else {
+            ++regressions;
+            ++interval_regressions;
+        }
+
+        restart(message);
+    }
+
+    void ClockMonitor::check_jump(const Message &message)
+    {
+        std::int64_t rx_step = timestamp_to_ns(last_type, message.timestamp()) - timestamp_to_ns(last_type, last_timestamp);
+        std::int64_t host_step = std::chrono::duration_cast<std::chrono::nanoseconds>(message.received() - last_received).count();
+
+        if (rx_step - host_step > std::chrono::duration_cast<std::chrono::nanoseconds>(jump_threshold).count()) {
+            ++jumps;
+            ++interval_jumps;
+            restart(message);
+        } else {
+            last_timestamp = message.timestamp();
+            last_received = message.received();
+        }
+    }
+
+    ClockMonitor::Summary ClockMonitor::summarize()
+    {
+        Summary summary;
+        summary.timestamp_type = last_type;
+        summary.regressions = regressions;
+        summary.jumps = jumps;
+        summary.rollovers = rollovers;
+        summary.interval_regressions = interval_regressions;
+        summary.interval_jumps = interval_jumps;
+        summary.baseline = std::chrono::duration_cast<std::chrono::milliseconds>(last_received - anchor_received);
+
+        summary.drift_valid = (last_type != TimestampType::UNKNOWN && summary.baseline >= drift_min_baseline);
+        if (summary.drift_valid) {
+            double rx_elapsed = timestamp_to_ns(last_type, last_timestamp) - anchor_ns;
+            double host_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(last_received - anchor_received).count();
+            summary.drift_ppm = (rx_elapsed - host_elapsed) / host_elapsed * 1e6;
+        } else {
+            summary.drift_ppm = 0;
+        }
+
+        interval_regressions = 0;
+        interval_jumps = 0;
+        return summary;
+    }
+};
@@ -0,0 +1,121 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODES_CLOCK_MONITOR_H
+#define MODES_CLOCK_MONITOR_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "modes_message.h"
+
+namespace modes {
+    // Watches the receiver timestamps on incoming messages for problems
+    // that would upset MLAT: timestamps going backwards, sudden jumps, and
+    // the rate of the receiver clock relative to the host's monotonic
+    // clock. GPS timestamps wrap at midnight; that is counted as a
+    // rollover, not a regression.
+    //
+    // The per-message cost is a compare and a subtraction in the common
+    // case; conversions to nanoseconds only happen for suspicious steps
+    // and when summarizing.
+    class ClockMonitor {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        // a step in receiver time that differs from the step in host time by
+        // more than this is counted as a jump
+        const std::chrono::milliseconds jump_threshold = std::chrono::milliseconds(500);
+
+        // if there are no messages for this long, don't compare the
+        // next timestamp with the previous one
+        const std::chrono::milliseconds idle_reset = std::chrono::seconds(5);
+
+        // don't report drift until we have this much baseline
+        const std::chrono::milliseconds drift_min_baseline = std::chrono::seconds(60);
+
+        struct Summary {
+            TimestampType timestamp_type;
+            std::uint64_t regressions;          // total timestamps that went backwards
+            std::uint64_t jumps;                // total jumps
+            std::uint64_t rollovers;            // total GPS midnight rollovers
+            std::uint64_t interval_regressions; // .. since the last summary
+            std::uint64_t interval_jumps;
+            bool drift_valid;
+            double drift_ppm;                   // receiver clock rate relative to host, parts per million
+            std::chrono::milliseconds baseline; // host time covered by the drift estimate
+        };
+
+        ClockMonitor();
+
+        void update(const Message &message) {
+            if (message.type() == MessageType::POSITION)
+                return;
+
+            if (message.timestamp_type() != last_type || message.received() - last_received > idle_reset) {
+                restart(message);
+                return;
+            }
+
+            std::uint64_t ts = message.timestamp();
+            if (ts < last_timestamp) {
+                step_backwards(message);
+                return;
+            }
+
+            if (ts - last_timestamp > jump_ticks)
+                check_jump(message);
+
+            last_timestamp = ts;
+            last_received = message.received();
+        }
+
+        Summary summarize();
+
+    private:
+        void restart(const Message &message);
+        void step_backwards(const Message &message);
+        void check_jump(const Message &message);
+
+        // timestamp of the last message, and when it arrived
+        TimestampType last_type;
+        std::uint64_t last_timestamp;
+        clock::time_point last_received;
+
+        // steps larger than this (in timestamp units) need a closer look
+        std::uint64_t jump_ticks;
+
+        // the start of the drift baseline
+        std::int64_t anchor_ns;
+        clock::time_point anchor_received;
+
+        std::uint64_t regressions, jumps, rollovers;
+        std::uint64_t interval_regressions, interval_jumps;
+    };
+};
+
+#endif
@@ -25,8 +25,11 @@
 
 #include "modes_filter.h"
 
+#include <algorithm>
 #include <iostream>
 
+#include "cpu_dispatch.h"
+
 namespace modes {
     Filter::Filter()
         : receive_modeac(false),
@@ -34,7 +37,9 @@ namespace modes {
           receive_fec(false),
           receive_status(false),
           receive_gps_timestamps(false),
-          receive_position(false)
+          receive_position(false),
+          receive_typecodes(0xFFFFFFFF),
+          min_signal(0)
     {
         receive_df.fill(false);
     }
@@ -49,6 +54,16 @@ namespace modes {
         receive_status = receive_status || two.receive_status;
         receive_gps_timestamps = receive_gps_timestamps || two.receive_gps_timestamps;
         receive_position = receive_position || two.receive_position;
+        receive_typecodes = receive_typecodes | two.receive_typecodes;
+        min_signal = std::min(min_signal, two.min_signal);
+
+        // The combined filter must pass anything either filter passes.
+        // We don't try to merge address sets (nothing upstream can use
+        // them), just drop them unless both sides agree.
+        if (address_allow != two.address_allow)
+            address_allow.reset();
+        if (address_deny != two.address_deny)
+            address_deny.reset();
     }
 
     Filter Filter::combine(const Filter &one, const Filter &two)
@@ -69,7 +84,11 @@ namespace modes {
                 receive_status == other.receive_status &&
                 receive_gps_timestamps == other.receive_gps_timestamps &&
                 receive_position == other.receive_position &&
-                receive_df == other.receive_df);
+                receive_df == other.receive_df &&
+                receive_typecodes == other.receive_typecodes &&
+                min_signal == other.min_signal &&
+                address_allow == other.address_allow &&
+                address_deny == other.address_deny);
     }
 
     bool Filter::operator!=(const Filter &other) const
@@ -92,6 +111,14 @@ namespace modes {
             os << "gps ";
         if (f.receive_position)
             os << "position ";
+        if (f.receive_typecodes != 0xFFFFFFFF)
+            os << "typecodes(" << std::hex << f.receive_typecodes << std::dec << ") ";
+        if (f.min_signal)
+            os << "signal>=" << (int)f.min_signal << " ";
+        if (f.address_allow)
+            os << "allow(" << f.address_allow->size() << ") ";
+        if (f.address_deny)
+            os << "deny(" << f.address_deny->size() << ") ";
         for (std::size_t i = 0; i < f.receive_df.size(); ++i)
             if (f.receive_df[i])
                 os << i << " ";
@@ -99,8 +126,45 @@ namespace modes {
         return os;
     }
 
+    FilterMask::FilterMask()
+        : accept(0),
+          reject(0),
+          typecodes(0xFFFFFFFF),
+          signal_classes(0),
+          min_signal(0)
+    {
+    }
+
+    FilterMask::FilterMask(const Filter &filter)
+        : FilterMask()
+    {
+        for (std::size_t i = 0; i < filter.receive_df.size(); ++i)
+            if (filter.receive_df[i])
+                accept |= Message::class_df(i);
+        if (filter.receive_modeac)
+            accept |= Message::CLASS_MODE_AC;
+        if (filter.receive_status)
+            accept |= Message::CLASS_STATUS;
+        if (filter.receive_position)
+            accept |= Message::CLASS_POSITION;
+
+        if (!filter.receive_bad_crc)
+            reject |= Message::CLASS_CRC_BAD;
+
+        typecodes = filter.receive_typecodes;
+
+        if (filter.min_signal) {
+            signal_classes = Message::CLASS_DF_ALL | Message::CLASS_MODE_AC;
+            min_signal = filter.min_signal;
+        }
+
+        address_allow = filter.address_allow;
+        address_deny = filter.address_deny;
+    }
+
     FilterDistributor::FilterDistributor()
-        : next_handle(0)
+        : next_handle(0),
+          rebuild_pending(false)
     {
     }
 
@@ -113,11 +177,14 @@ namespace modes {
                                                             const Filter &initial_filter)
     {
         handle h = next_handle++;
-        clients[h] = {
+        client &c = clients[h] = {
             message_notifier,
             initial_filter,
+            FilterMask(initial_filter),
+            0,
             false
         };
+        add_slot(c);
         update_upstream_filter();
         return h;
     }
@@ -137,6 +204,8 @@ namespace modes {
             return;
 
         c.filter = new_filter;
+        c.mask = FilterMask(new_filter);
+        store_slot(c);
         update_upstream_filter();
     }
 
@@ -151,21 +220,80 @@ namespace modes {
             return;
 
         c.deleted = true;
+        slot_accept[c.slot] = 0;
+        rebuild_pending = true;
         update_upstream_filter();
     }
 
+    void FilterDistributor::add_monitor(MessageNotifier monitor)
+    {
+        monitors.push_back(monitor);
+    }
+
     void FilterDistributor::broadcast(const Message &message)
     {
-        for (auto i = clients.begin(); i != clients.end(); ) {
-            client &c = i->second;
-            if (!c.deleted && c.filter(message))
-                c.notifier(message);
+        for (const auto &m : monitors)
+            m(message);
 
-            if (c.deleted)
+        // Work out every interested client before notifying any, so
+        // clients added by a notifier don't see this message; ones
+        // removed by a notifier are skipped via their deleted flag.
+        std::size_t n = slot_clients.size();
+        matches.resize((n + 63) / 64);
+        helpers::kernels.match_masks(n,
+                                     slot_accept.data(),
+                                     slot_reject.data(),
+                                     slot_typecode_reject.data(),
+                                     message.classes(),
+                                     message.typecode_bits(),
+                                     matches.data());
+
+        for (std::size_t w = 0; w < matches.size(); ++w) {
+            for (std::uint64_t bits = matches[w]; bits; bits &= bits - 1) {
+                client &c = *slot_clients[w * 64 + __builtin_ctzll(bits)];
+                if (!c.deleted && c.mask.match_details(message))
+                    c.notifier(message);
+            }
+        }
+
+        if (rebuild_pending)
+            rebuild_slots();
+    }
+
+    void FilterDistributor::add_slot(client &c)
+    {
+        c.slot = slot_clients.size();
+        slot_clients.push_back(&c);
+        slot_accept.push_back(0);
+        slot_reject.push_back(0);
+        slot_typecode_reject.push_back(0);
+        store_slot(c);
+    }
+
+    void FilterDistributor::store_slot(const client &c)
+    {
+        slot_accept[c.slot] = c.mask.accept;
+        slot_reject[c.slot] = c.mask.reject;
+        slot_typecode_reject[c.slot] = ~c.mask.typecodes & 0xFFFFFFFFULL;
+    }
+
+    void FilterDistributor::rebuild_slots()
+    {
+        slot_clients.clear();
+        slot_accept.clear();
+        slot_reject.clear();
+        slot_typecode_reject.clear();
+
+        for (auto i = clients.begin(); i != clients.end(); ) {
+            if (i->second.deleted) {
                 clients.erase(i++);
-            else
+            } else {
+                add_slot(i->second);
                 ++i;
+            }
         }
+
+        rebuild_pending = false;
     }
 
     void FilterDistributor::update_upstream_filter()
@@ -29,9 +29,11 @@
 #define MODES_FILTER_H
 
 #include <array>
+#include <memory>
 #include <ostream>
 
 #include "modes_message.h"
+#include "modes_address_set.h"
 
 namespace modes {
     struct Filter {
@@ -43,6 +45,17 @@ namespace modes {
         bool receive_gps_timestamps;
         bool receive_position;
 
+        // bit N set: receive extended squitters with ME type code N
+        std::uint32_t receive_typecodes;
+
+        // don't receive Mode A/C or Mode S messages weaker than this
+        std::uint8_t min_signal;
+
+        // if set, only Mode S messages from these addresses are received
+        std::shared_ptr<const AddressSet> address_allow;
+        // if set, Mode S messages from these addresses are not received
+        std::shared_ptr<const AddressSet> address_deny;
+
         Filter();
 
         void inplace_combine(const Filter &two);
@@ -50,31 +63,59 @@ namespace modes {
 
         bool operator==(const Filter &other) const;
         bool operator!=(const Filter &other) const;
+    };
+
+    std::ostream &operator<<(std::ostream &os, const Filter &f);
+
+    // A Filter reduced to masks over Message::classes(), which is what
+    // actually gets applied to each message.
+    struct FilterMask {
+        // a message passes if it has at least one accept bit, no reject
+        // bits, and no type code bit outside typecodes
+        std::uint64_t accept;
+        std::uint64_t reject;
+        std::uint32_t typecodes;
+
+        // classes that min_signal applies to
+        std::uint64_t signal_classes;
+        std::uint8_t min_signal;
+
+        // checked for Mode S messages only
+        std::shared_ptr<const AddressSet> address_allow;
+        std::shared_ptr<const AddressSet> address_deny;
+
+        // passes nothing
+        FilterMask();
+        explicit FilterMask(const Filter &filter);
 
         bool operator()(const Message &message) const {
-            switch (message.type()) {
-            case MessageType::MODE_AC:
-                return receive_modeac;
-            case MessageType::STATUS:
-                return receive_status;
-            case MessageType::MODE_S_SHORT:
-            case MessageType::MODE_S_LONG:
-                if (!receive_df[message.df()])
-                    return false;
-                if (message.crc_bad() && !receive_bad_crc)
-                    return false;
-                return true;
-            case MessageType::POSITION:
-                return receive_position;
-
-            default:
-                // what is this?
+            std::uint64_t classes = message.classes();
+            if (!(classes & accept) || (classes & reject))
+                return false;
+            if (message.typecode_bits() & ~typecodes)
                 return false;
-            }
+            return match_details(message);
         }
-    };
 
-    std::ostream &operator<<(std::ostream &os, const Filter &f);
+        // the checks that need more than the message's class bits
+        bool match_details(const Message &message) const {
+            std::uint64_t classes = message.classes();
+            if ((classes & signal_classes) && message.signal() < min_signal)
+                return false;
+            if ((address_allow || address_deny) && (classes & Message::CLASS_DF_ALL))
+                return match_address(message.address());
+            return true;
+        }
+
+    private:
+        bool match_address(int address) const {
+            if (address_allow && (address < 0 || !address_allow->contains(address)))
+                return false;
+            if (address_deny && address >= 0 && address_deny->contains(address))
+                return false;
+            return true;
+        }
+    };
 
     class FilterDistributor {
     public:
@@ -92,10 +133,19 @@ namespace modes {
         void update_client_filter(handle client, const Filter &new_filter);
         void remove_client(handle client);
 
+        // monitors see every message received, before any filtering,
+        // and do not affect the upstream filter
+        void add_monitor(MessageNotifier monitor);
+
         void broadcast(const Message& message);
 
     private:
+        struct client;
+
         void update_upstream_filter();
+        void add_slot(client &c);
+        void store_slot(const client &c);
+        void rebuild_slots();
 
         handle next_handle;
         FilterNotifier filter_notifier;
@@ -103,10 +153,26 @@ namespace modes {
         struct client {
             MessageNotifier notifier;
             Filter filter;
+            FilterMask mask;
+            std::size_t slot;
             bool deleted;
         };
 
         std::map<handle, client> clients;
+
+        // The class masks of the live clients, one array per field, so
+        // that broadcast() can test a message against every client with
+        // one kernels.match_masks call and then visit only the clients
+        // it passes. Slot i belongs to slot_clients[i]; slots are kept in
+        // handle order. Removed clients have their accept mask cleared
+        // and are compacted away after the next broadcast.
+        std::vector<std::uint64_t> slot_accept;
+        std::vector<std::uint64_t> slot_reject;
+        std::vector<std::uint64_t> slot_typecode_reject;
+        std::vector<client*> slot_clients;
+        std::vector<std::uint64_t> matches;
+        bool rebuild_pending;
+        std::vector<MessageNotifier> monitors;
     };
 };
 
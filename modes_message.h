@@ -30,6 +30,7 @@
 
 #include <cstdint>
 #include <cassert>
+#include <chrono>
 #include <vector>
 #include <ostream>
 #include <functional>
@@ -73,6 +74,41 @@ namespace modes {
         }
     }
 
+    // convert a receiver timestamp to nanoseconds. GPS timestamps give
+    // nanoseconds since midnight; 12MHz timestamps count from an arbitrary
+    // point.
+    inline std::int64_t timestamp_to_ns(TimestampType type, std::uint64_t timestamp)
+    {
+        switch (type) {
+        case TimestampType::GPS:
+            // seconds since midnight in the top bits, nanoseconds in the low 30 bits
+            return (std::int64_t)(timestamp >> 30) * 1000000000LL + (std::int64_t)(timestamp & 0x3FFFFFFF);
+        case TimestampType::TWELVEMEG:
+            return (std::int64_t)(timestamp * 1000ULL / 12ULL);
+        default:
+            return 0;
+        }
+    }
+
+    // reorder the bits of a 13-bit ID field (C1 A1 C2 A2 C4 A4 X B1 D1 B2 D2 B4 D4)
+    // into one octal digit per nibble (A4 A2 A1, B4 B2 B1, C4 C2 C1, D4 D2 D1)
+    inline int decode_id13(int id13) {
+        int squawk = 0;
+        if (id13 & 0x1000) squawk |= 0x0010; // C1
+        if (id13 & 0x0800) squawk |= 0x1000; // A1
+        if (id13 & 0x0400) squawk |= 0x0020; // C2
+        if (id13 & 0x0200) squawk |= 0x2000; // A2
+        if (id13 & 0x0100) squawk |= 0x0040; // C4
+        if (id13 & 0x0080) squawk |= 0x4000; // A4
+        if (id13 & 0x0020) squawk |= 0x0100; // B1
+        if (id13 & 0x0010) squawk |= 0x0001; // D1
+        if (id13 & 0x0008) squawk |= 0x0200; // B2
+        if (id13 & 0x0004) squawk |= 0x0002; // D2
+        if (id13 & 0x0002) squawk |= 0x0400; // B4
+        if (id13 & 0x0001) squawk |= 0x0004; // D4
+        return squawk;
+    }
+
     extern std::uint32_t crc_table[256];
 
     template <class InputIterator>
@@ -92,33 +128,41 @@ namespace modes {
               m_timestamp_type(TimestampType::UNKNOWN),
               m_timestamp(0),
               m_signal(0),
-              residual(0xFFFFFFFF)
+              m_classes(0),
+              m_typecode_bits(0),
+              decoded(0)
         {}
 
         Message(MessageType type_,
                 TimestampType timestamp_type_, std::uint64_t timestamp_,
-                std::uint8_t signal_, std::vector<std::uint8_t> &&data_)
+                std::uint8_t signal_, std::vector<std::uint8_t> &&data_,
+                std::chrono::steady_clock::time_point received_ = std::chrono::steady_clock::time_point())
             : m_type(type_),
               m_timestamp_type(timestamp_type_),
               m_timestamp(timestamp_),
               m_signal(signal_),
               m_data(std::move(data_)),
-              residual(0xFFFFFFFF)
+              m_received(received_),
+              decoded(0)
         {
             assert (m_data.size() == message_size(m_type));
+            classify();
         }
 
         Message(MessageType type_,
                 TimestampType timestamp_type_, std::uint64_t timestamp_,
-                std::uint8_t signal_, const std::vector<std::uint8_t> &data_)
+                std::uint8_t signal_, const std::vector<std::uint8_t> &data_,
+                std::chrono::steady_clock::time_point received_ = std::chrono::steady_clock::time_point())
             : m_type(type_),
               m_timestamp_type(timestamp_type_),
               m_timestamp(timestamp_),
               m_signal(signal_),
               m_data(data_),
-              residual(0xFFFFFFFF)
+              m_received(received_),
+              decoded(0)
         {
             assert (m_data.size() == message_size(m_type));
+            classify();
         }
 
         MessageType type() const {
@@ -141,14 +185,68 @@ namespace modes {
             return m_data;
         }
 
+        // host time at which the message was read from the receiver
+        std::chrono::steady_clock::time_point received() const {
+            return m_received;
+        }
+
+        // What filters look at, worked out once when the message is
+        // constructed: exactly one of the DF, Mode A/C, status and
+        // position bits, plus CLASS_CRC_BAD for Mode S messages that fail
+        // their CRC check. The DF bits are bit N for DF N.
+        enum : std::uint64_t {
+            CLASS_DF_ALL = 0xFFFFFFFFULL,
+            CLASS_MODE_AC = 1ULL << 32,
+            CLASS_STATUS = 1ULL << 33,
+            CLASS_POSITION = 1ULL << 34,
+            CLASS_CRC_BAD = 1ULL << 35
+        };
+
+        static std::uint64_t class_df(int df) {
+            return 1ULL << df;
+        }
+
+        std::uint64_t classes() const {
+            return m_classes;
+        }
+
+        // bit N set for an extended squitter with ME type code N, else 0
+        std::uint32_t typecode_bits() const {
+            return m_typecode_bits;
+        }
+
+        // Fields derived from the message data are decoded lazily, at most
+        // once per message, and cached. A single Message is shared by all
+        // clients, so each field is decoded once regardless of how many
+        // filters or outputs look at it. decoded_fields() says which fields
+        // have been decoded so far.
+        enum DecodedField : std::uint8_t {
+            DECODED_DF = 0x01,
+            DECODED_RESIDUAL = 0x02,
+            DECODED_ADDRESS = 0x04,
+            DECODED_TYPECODE = 0x08,
+            DECODED_SQUAWK = 0x10
+        };
+
+        std::uint8_t decoded_fields() const {
+            return decoded;
+        }
+
+        // the downlink format of a Mode S message, or -1
         int df() const {
-            switch (m_type) {
-            case MessageType::MODE_S_SHORT:
-            case MessageType::MODE_S_LONG:
-                return (m_data[0] >> 3) & 31;
-            default:
-                return -1;
+            if (!(decoded & DECODED_DF)) {
+                switch (m_type) {
+                case MessageType::MODE_S_SHORT:
+                case MessageType::MODE_S_LONG:
+                    m_df = (m_data[0] >> 3) & 31;
+                    break;
+                default:
+                    m_df = -1;
+                    break;
+                }
+                decoded |= DECODED_DF;
             }
+            return m_df;
         }
 
         bool crc_bad() const {
@@ -163,20 +261,126 @@ namespace modes {
             }
         }
 
+        // the 24-bit ICAO address of the transponder that sent this message,
+        // or -1 if the message does not carry one. For formats where the
+        // address is overlaid on the CRC (AP field) this assumes the CRC is
+        // otherwise good.
+        int address() const {
+            if (!(decoded & DECODED_ADDRESS)) {
+                switch (df()) {
+                case 11:
+                case 17:
+                case 18:
+                    m_address = (m_data[1] << 16) | (m_data[2] << 8) | m_data[3];
+                    break;
+                case 0:
+                case 4:
+                case 5:
+                case 16:
+                case 20:
+                case 21:
+                    m_address = crc_residual();
+                    break;
+                default:
+                    m_address = -1;
+                    break;
+                }
+                decoded |= DECODED_ADDRESS;
+            }
+            return m_address;
+        }
+
+        // the ME type code of an extended squitter, or -1
+        int typecode() const {
+            if (!(decoded & DECODED_TYPECODE)) {
+                m_typecode = -1;
+                switch (df()) {
+                case 17:
+                    m_typecode = m_data[4] >> 3;
+                    break;
+                case 18:
+                    // CF values that carry an ADS-B format ME field
+                    switch (m_data[0] & 7) {
+                    case 0: case 1: case 2: case 5: case 6:
+                        m_typecode = m_data[4] >> 3;
+                        break;
+                    }
+                    break;
+                }
+                decoded |= DECODED_TYPECODE;
+            }
+            return m_typecode;
+        }
+
+        // the Mode A code (squawk) carried by a Mode A/C, DF5 or DF21
+        // message, or -1. The four octal digits are returned one per
+        // nibble, so squawk 7700 is 0x7700.
+        int squawk() const {
+            if (!(decoded & DECODED_SQUAWK)) {
+                switch (m_type) {
+                case MessageType::MODE_AC:
+                    m_squawk = ((m_data[0] << 8) | m_data[1]) & 0x7777;
+                    break;
+                case MessageType::MODE_S_SHORT:
+                case MessageType::MODE_S_LONG:
+                    if (df() == 5 || df() == 21)
+                        m_squawk = decode_id13(((m_data[2] << 8) | m_data[3]) & 0x1FFF);
+                    else
+                        m_squawk = -1;
+                    break;
+                default:
+                    m_squawk = -1;
+                    break;
+                }
+                decoded |= DECODED_SQUAWK;
+            }
+            return m_squawk;
+        }
+
     private:
+        void classify() {
+            m_classes = 0;
+            m_typecode_bits = 0;
+
+            switch (m_type) {
+            case MessageType::MODE_AC:
+                m_classes = CLASS_MODE_AC;
+                break;
+            case MessageType::STATUS:
+                m_classes = CLASS_STATUS;
+                break;
+            case MessageType::POSITION:
+                m_classes = CLASS_POSITION;
+                break;
+            case MessageType::MODE_S_SHORT:
+            case MessageType::MODE_S_LONG: {
+                m_classes = class_df(df());
+                if (crc_bad())
+                    m_classes |= CLASS_CRC_BAD;
+                int tc = typecode();
+                if (tc >= 0)
+                    m_typecode_bits = 1U << tc;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+
         std::uint32_t crc_residual() const {
-            if (residual == 0xFFFFFFFF) {
+            if (!(decoded & DECODED_RESIDUAL)) {
                 std::size_t len = m_data.size();
                 if (len <= 3) {
-                    residual = 0;
+                    m_residual = 0;
                 } else {
-                    residual = crc(m_data.begin(), m_data.end() - 3);
-                    residual ^= (m_data[len-3] << 16);
-                    residual ^= (m_data[len-2] << 8);
-                    residual ^= (m_data[len-1]);
+                    m_residual = crc(m_data.begin(), m_data.end() - 3);
+                    m_residual ^= (m_data[len-3] << 16);
+                    m_residual ^= (m_data[len-2] << 8);
+                    m_residual ^= (m_data[len-1]);
                 }
+                decoded |= DECODED_RESIDUAL;
             }
-            return residual;
+            return m_residual;
         }
 
         MessageType m_type;
@@ -184,8 +388,17 @@ namespace modes {
         std::uint64_t m_timestamp;
         std::uint8_t m_signal;
         std::vector<std::uint8_t> m_data;
+        std::chrono::steady_clock::time_point m_received;
+        std::uint64_t m_classes;
+        std::uint32_t m_typecode_bits;
 
-        mutable std::uint32_t residual;
+        // lazily decoded fields, see decoded_fields()
+        mutable std::uint8_t decoded;
+        mutable std::int8_t m_df;
+        mutable std::int8_t m_typecode;
+        mutable std::uint32_t m_residual;
+        mutable std::int32_t m_address;
+        mutable std::int32_t m_squawk;
     };
 
     std::ostream& operator<<(std::ostream &os, const Message &message);
@@ -0,0 +1,159 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "modes_rate_limiter.h"
+#include "modes_address_set.h"
+
+#include <algorithm>
+
+namespace modes {
+    const std::uint32_t RateLimiter::empty;
+
+    RateLimiter::RateLimiter(unsigned count_, std::chrono::milliseconds interval_)
+        : emission_interval(std::chrono::duration_cast<clock::duration>(interval_) / count_),
+          burst_tolerance(std::chrono::duration_cast<clock::duration>(interval_) - emission_interval),
+          keys(256, empty),
+          arrival(256),
+          mask(255),
+          count(0)
+    {
+    }
+
+    int RateLimiter::message_class(const Message &message)
+    {
+        if (message.address() < 0)
+            return -1;
+
+        int typecode = message.typecode();
+        if (typecode < 0)
+            return message.df();         // 0..31
+
+        if (typecode >= 1 && typecode <= 4)
+            return 32;                   // identification
+        if (typecode >= 5 && typecode <= 8)
+            return 33;                   // surface position
+        if ((typecode >= 9 && typecode <= 18) || (typecode >= 20 && typecode <= 22))
+            return 34;                   // airborne position
+        if (typecode == 19)
+            return 35;                   // airborne velocity
+        return 36;                       // everything else
+    }
+
+    std::size_t RateLimiter::lookup(std::uint32_t key) const
+    {
+        std::uint32_t i = address_hash(key) & mask;
+        while (keys[i] != key && keys[i] != empty)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    bool RateLimiter::operator()(const Message &message)
+    {
+        int mclass = message_class(message);
+        if (mclass < 0)
+            return true;
+
+        std::uint32_t key = ((std::uint32_t)mclass << 24) | (std::uint32_t)message.address();
+        clock::time_point now = message.received();
+
+        std::size_t i = lookup(key);
+        if (keys[i] == empty) {
+            if ((count + 1) * 2 > keys.size()) {
+                make_room(now);
+                i = lookup(key);
+            }
+
+            keys[i] = key;
+            arrival[i] = now + emission_interval;
+            ++count;
+            return true;
+        }
+
+        clock::time_point tat = std::max(arrival[i], now);
+        if (tat - now > burst_tolerance)
+            return false;
+
+        arrival[i] = tat + emission_interval;
+        return true;
+    }
+
+    void RateLimiter::make_room(clock::time_point now)
+    {
+        // Buckets whose arrival time has passed are full again and can
+        // be forgotten. Drop them in place; grow only if that doesn't
+        // free up enough space.
+        for (std::size_t i = 0; i < keys.size(); ) {
+            if (keys[i] != empty && arrival[i] <= now) {
+                // erase() may move a later entry into slot i, so look at it again
+                erase(i);
+            } else {
+                ++i;
+            }
+        }
+
+        if ((count + 1) * 4 > keys.size())
+            rehash(keys.size() * 2);
+    }
+
+    void RateLimiter::erase(std::size_t i)
+    {
+        // backward-shift deletion, see AircraftTable::erase
+        std::size_t j = i;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (keys[j] == empty)
+                break;
+
+            std::size_t home = address_hash(keys[j]) & mask;
+            bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stays) {
+                keys[i] = keys[j];
+                arrival[i] = arrival[j];
+                i = j;
+            }
+        }
+
+        keys[i] = empty;
+        --count;
+    }
+
+    void RateLimiter::rehash(std::size_t new_size)
+    {
+        std::vector<std::uint32_t> old_keys(new_size, empty);
+        std::vector<clock::time_point> old_arrival(new_size);
+        old_keys.swap(keys);
+        old_arrival.swap(arrival);
+        mask = new_size - 1;
+
+        for (std::size_t j = 0; j < old_keys.size(); ++j) {
+            if (old_keys[j] == empty)
+                continue;
+
+            std::size_t i = lookup(old_keys[j]);
+            keys[i] = old_keys[j];
+            arrival[i] = old_arrival[j];
+        }
+    }
+};
@@ -0,0 +1,78 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODES_RATE_LIMITER_H
+#define MODES_RATE_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "modes_message.h"
+
+namespace modes {
+    // Limits the number of messages passed per aircraft and message type
+    // to at most 'count' in any 'interval'.
+    //
+    // Each (address, message type) pair has a token bucket, implemented as
+    // a single "theoretical arrival time" (GCRA). A bucket that has refilled
+    // completely is equivalent to no bucket at all, so stale entries are
+    // dropped when the table gets full instead of on a timer. The table
+    // only allocates when it needs to grow.
+    class RateLimiter {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        RateLimiter(unsigned count, std::chrono::milliseconds interval);
+
+        // returns true if the message should be passed. Messages without an
+        // ICAO address are never limited.
+        bool operator()(const Message &message);
+
+        // The message type that limits apply to: the DF for most messages,
+        // or a broad ME category for extended squitter. -1 if not limited.
+        static int message_class(const Message &message);
+
+    private:
+        static const std::uint32_t empty = 0xFFFFFFFF;
+
+        std::size_t lookup(std::uint32_t key) const;
+        void make_room(clock::time_point now);
+        void erase(std::size_t i);
+        void rehash(std::size_t new_size);
+
+        clock::duration emission_interval;  // interval / count
+        clock::duration burst_tolerance;    // interval - emission_interval
+
+        std::vector<std::uint32_t> keys;
+        std::vector<clock::time_point> arrival;
+        std::uint32_t mask;
+        std::size_t count;
+    };
+};
+
+#endif
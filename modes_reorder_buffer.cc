@@ -0,0 +1,49 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "modes_reorder_buffer.h"
+
+namespace modes {
+    ReorderBuffer::ReorderBuffer(std::chrono::milliseconds hold_, std::size_t capacity)
+        : hold_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(hold_).count()),
+          hold(std::chrono::duration_cast<clock::duration>(hold_)),
+          // size each slot's data for the longest message so that
+          // assigning into it never needs to allocate
+          slots(capacity, Message(MessageType::MODE_S_LONG, TimestampType::UNKNOWN, 0, 0,
+                                  std::vector<std::uint8_t>(message_size(MessageType::MODE_S_LONG)))),
+          key_ns(capacity),
+          key_seq(capacity),
+          current_type(TimestampType::UNKNOWN),
+          newest_ns(0),
+          released_ns(std::numeric_limits<std::int64_t>::min()),
+          next_seq(0),
+          m_stats { 0, 0, 0, clock::duration::zero(), clock::duration::zero() }
+    {
+        heap.reserve(capacity);
+        free_slots.reserve(capacity);
+        for (std::size_t i = capacity; i > 0; --i)
+            free_slots.push_back(i - 1);
+    }
+};
@@ -0,0 +1,204 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODES_REORDER_BUFFER_H
+#define MODES_REORDER_BUFFER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "modes_message.h"
+
+namespace modes {
+    // Holds timestamped messages for a short time and releases them in
+    // timestamp order, for consumers that can't cope with the out-of-order
+    // data produced by merging several receivers.
+    //
+    // Messages live in a fixed pool of slots that is allocated up front and
+    // reused by copy-assignment; a binary min-heap of slot indices orders
+    // them by (timestamp, arrival order). Nothing is allocated after
+    // construction.
+    //
+    // The head of the heap is released once any of these is true:
+    //
+    //  * a message has been seen with a timestamp more than 'hold' later
+    //    (anything earlier should have arrived by now)
+    //  * it has been held for 'hold' in host time (the input went quiet)
+    //  * the pool is full
+    //
+    // Only Mode A/C and Mode S messages with a known timestamp type are
+    // reordered; the caller should pass anything else straight through.
+    class ReorderBuffer {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        ReorderBuffer(std::chrono::milliseconds hold, std::size_t capacity = 4096);
+
+        // true if this message can be reordered
+        static bool reorderable(const Message &message) {
+            return (message.type() == MessageType::MODE_AC ||
+                    message.type() == MessageType::MODE_S_SHORT ||
+                    message.type() == MessageType::MODE_S_LONG) &&
+                message.timestamp_type() != TimestampType::UNKNOWN;
+        }
+
+        // Add a message. Any messages that must be released to make room,
+        // or because the timestamp type changed or the GPS clock rolled
+        // over at midnight, are passed to 'emit' first.
+        template <class F> void push(const Message &message, F emit);
+
+        // Pass any messages that are due at 'now' to 'emit', in order.
+        template <class F> void release(clock::time_point now, F emit);
+
+        // Pass all held messages to 'emit', in order.
+        template <class F> void flush(F emit);
+
+        bool empty() const {
+            return heap.empty();
+        }
+
+        // host time at which the head of the buffer is due to be released
+        // by the hold timeout. Only meaningful if !empty().
+        clock::time_point deadline() const {
+            return slots[heap.front()].received() + hold;
+        }
+
+        // statistics on the latency added by the buffer
+        struct Stats {
+            std::uint64_t messages;    // messages released
+            std::uint64_t late;        // messages that arrived after a later one was released
+            std::uint64_t overflows;   // messages released early because the buffer was full
+            clock::duration total_delay;
+            clock::duration max_delay;
+        };
+
+        const Stats &stats() const {
+            return m_stats;
+        }
+
+    private:
+        struct Later {
+            const ReorderBuffer *buffer;
+            bool operator()(std::uint32_t a, std::uint32_t b) const {
+                const ReorderBuffer &r = *buffer;
+                return r.key_ns[a] > r.key_ns[b] || (r.key_ns[a] == r.key_ns[b] && r.key_seq[a] > r.key_seq[b]);
+            }
+        };
+
+        template <class F> void pop(clock::time_point now, F emit);
+
+        std::chrono::nanoseconds::rep hold_ns;
+        clock::duration hold;
+
+        std::vector<Message> slots;
+        std::vector<std::int64_t> key_ns;
+        std::vector<std::uint64_t> key_seq;
+        std::vector<std::uint32_t> heap;
+        std::vector<std::uint32_t> free_slots;
+
+        TimestampType current_type;
+        std::int64_t newest_ns;
+        std::int64_t released_ns;
+        std::uint64_t next_seq;
+
+        Stats m_stats;
+    };
+
+    template <class F> void ReorderBuffer::pop(clock::time_point now, F emit)
+    {
+        std::pop_heap(heap.begin(), heap.end(), Later { this });
+        std::uint32_t i = heap.back();
+        heap.pop_back();
+
+        if (key_ns[i] < released_ns)
+            ++m_stats.late;
+        else
+            released_ns = key_ns[i];
+
+        clock::duration delay = now - slots[i].received();
+        ++m_stats.messages;
+        m_stats.total_delay += delay;
+        m_stats.max_delay = std::max(m_stats.max_delay, delay);
+
+        emit(slots[i]);
+        free_slots.push_back(i);
+    }
+
+    template <class F> void ReorderBuffer::push(const Message &message, F emit)
+    {
+        std::int64_t ns = timestamp_to_ns(message.timestamp_type(), message.timestamp());
+        clock::time_point now = message.received();
+
+        if (message.timestamp_type() != current_type || (current_type == TimestampType::GPS && ns + 43200000000000LL < newest_ns)) {
+            // timestamps aren't comparable with what we hold; start again
+            flush(emit);
+            current_type = message.timestamp_type();
+            newest_ns = ns;
+            released_ns = std::numeric_limits<std::int64_t>::min();
+        }
+
+        if (free_slots.empty()) {
+            ++m_stats.overflows;
+            pop(now, emit);
+        }
+
+        std::uint32_t i = free_slots.back();
+        free_slots.pop_back();
+
+        slots[i] = message;
+        key_ns[i] = ns;
+        key_seq[i] = next_seq++;
+        heap.push_back(i);
+        std::push_heap(heap.begin(), heap.end(), Later { this });
+
+        newest_ns = std::max(newest_ns, ns);
+        release(now, emit);
+    }
+
+    template <class F> void ReorderBuffer::release(clock::time_point now, F emit)
+    {
+        while (!heap.empty()) {
+            std::uint32_t i = heap.front();
+            // messages that are already late gain nothing from waiting
+            if (key_ns[i] >= released_ns && newest_ns - key_ns[i] <= hold_ns && now - slots[i].received() < hold)
+                break;
+            pop(now, emit);
+        }
+    }
+
+    template <class F> void ReorderBuffer::flush(F emit)
+    {
+        clock::time_point now = clock::now();
+        while (!heap.empty())
+            pop(now, emit);
+    }
+};
+
+#endif
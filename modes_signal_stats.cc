@@ -0,0 +1,100 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "modes_signal_stats.h"
+
+#include <cmath>
+
+namespace modes {
+    const unsigned SignalStats::bin_width;
+    const unsigned SignalStats::bins;
+    const unsigned SignalStats::modeac_row;
+
+    SignalStats::SignalStats()
+    {
+        for (auto &h : histogram)
+            h.fill(0);
+        signal_sum.fill(0);
+    }
+
+    double SignalStats::to_dbfs(double signal)
+    {
+        // the signal byte is proportional to amplitude
+        if (signal <= 0)
+            return -99.9;
+        return 20 * std::log10(signal / 255.0);
+    }
+
+    double SignalStats::percentile(const Histogram &h, std::uint64_t total, double fraction)
+    {
+        if (total == 0)
+            return 0;
+
+        std::uint64_t target = (std::uint64_t)std::ceil(total * fraction);
+        std::uint64_t seen = 0;
+        for (unsigned bin = 0; bin < bins; ++bin) {
+            seen += h[bin];
+            if (seen >= target)
+                return bin * bin_width + (bin_width - 1) / 2.0; // bin midpoint
+        }
+
+        return 255;
+    }
+
+    SignalStats::Summary SignalStats::summarize()
+    {
+        Summary summary;
+        Histogram all;
+        all.fill(0);
+        summary.messages = 0;
+
+        for (unsigned row = 0; row < histogram.size(); ++row) {
+            const Histogram &h = histogram[row];
+            std::uint64_t messages = 0;
+            for (unsigned bin = 0; bin < bins; ++bin) {
+                messages += h[bin];
+                all[bin] += h[bin];
+            }
+
+            Row &r = summary.rows[row];
+            r.messages = messages;
+            r.mean = (messages ? (double)signal_sum[row] / messages : 0.0);
+            r.p10 = percentile(h, messages, 0.10);
+            summary.messages += messages;
+        }
+
+        summary.p10 = percentile(all, summary.messages, 0.10);
+        summary.median = percentile(all, summary.messages, 0.50);
+        summary.p90 = percentile(all, summary.messages, 0.90);
+        summary.strong_fraction = (summary.messages ? (double)all[bins - 1] / summary.messages : 0.0);
+
+        // start a new interval
+        for (auto &h : histogram)
+            h.fill(0);
+        signal_sum.fill(0);
+
+        return summary;
+    }
+};
@@ -0,0 +1,102 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MODES_SIGNAL_STATS_H
+#define MODES_SIGNAL_STATS_H
+
+#include <array>
+#include <cstdint>
+
+#include "modes_message.h"
+
+namespace modes {
+    // Signal level histograms for received Mode A/C and Mode S messages,
+    // kept separately for each DF (plus one row for Mode A/C) in fixed bins,
+    // so updating them is one increment and never allocates.
+    //
+    // Statistics cover the interval since the previous call to summarize(),
+    // which starts a new interval.
+    class SignalStats {
+    public:
+        // each bin covers this many signal levels
+        static const unsigned bin_width = 4;
+        static const unsigned bins = 256 / bin_width;
+
+        // the row used for Mode A/C messages
+        static const unsigned modeac_row = 32;
+
+        struct Row {
+            std::uint64_t messages;
+            double mean;
+            double p10;         // 10th percentile of signal level
+        };
+
+        struct Summary {
+            std::uint64_t messages;
+            double p10;         // 10th percentile: an estimate of the weakest messages we still decode
+            double median;
+            double p90;
+            double strong_fraction; // fraction of messages at or near full scale
+            std::array<Row,33> rows;
+        };
+
+        SignalStats();
+
+        void update(const Message &message) {
+            unsigned row;
+            switch (message.type()) {
+            case MessageType::MODE_AC:
+                row = modeac_row;
+                break;
+            case MessageType::MODE_S_SHORT:
+            case MessageType::MODE_S_LONG:
+                row = message.df();
+                break;
+            default:
+                return;
+            }
+
+            ++histogram[row][message.signal() / bin_width];
+            signal_sum[row] += message.signal();
+        }
+
+        Summary summarize();
+
+        // convert a signal level to dBFS
+        static double to_dbfs(double signal);
+
+    private:
+        typedef std::array<std::uint32_t,bins> Histogram;
+
+        static double percentile(const Histogram &h, std::uint64_t total, double fraction);
+
+        std::array<Histogram,33> histogram;
+        std::array<std::uint64_t,33> signal_sum;
+    };
+};
+
+#endif
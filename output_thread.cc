@@ -0,0 +1,103 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+
+#include <pthread.h>
+
+#include "output_thread.h"
+
+namespace splitter {
+    OutputThread::OutputThread(boost::asio::io_service &main_service_,
+                               modes::FilterDistributor &main_distributor_,
+                               const std::string &name_,
+                               const SchedulingOptions &scheduling_)
+        : main_service(main_service_),
+          main_distributor(main_distributor_),
+          thread_name(name_),
+          work(new boost::asio::io_service::work(thread_service))
+    {
+        // Nothing is wanted until an output on this thread asks for it.
+        // Filter changes happen on the output thread, so they are passed
+        // back to the main thread to apply.
+        main_handle = main_distributor.add_client(std::bind(&OutputThread::deliver, this, std::placeholders::_1), modes::Filter());
+        thread_distributor.set_filter_notifier([this] (const modes::Filter &filter) {
+                main_service.post([this,filter] {
+                        main_distributor.update_client_filter(main_handle, filter);
+                    });
+            });
+
+        thread = std::thread(&OutputThread::run, this, scheduling_);
+    }
+
+    OutputThread::~OutputThread()
+    {
+        work.reset();
+        thread_service.stop();
+        thread.join();
+    }
+
+    // Called on the main thread for each message the thread's outputs want
+    void OutputThread::deliver(const modes::Message &message)
+    {
+        bool first;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            first = pending.empty();
+            pending.push_back(message);
+        }
+
+        if (first)
+            thread_service.post(std::bind(&OutputThread::flush, this));
+    }
+
+    void OutputThread::flush()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            delivering.swap(pending);
+        }
+
+        for (const auto &message : delivering)
+            thread_distributor.broadcast(message);
+        delivering.clear();
+    }
+
+    void OutputThread::run(SchedulingOptions scheduling)
+    {
+        // shows up in top -H and /proc; the kernel limit is 15 characters
+        std::string title = ("out-" + thread_name).substr(0, 15);
+        pthread_setname_np(pthread_self(), title.c_str());
+
+        if (scheduling.any()) {
+            SchedulingStatus status = apply_scheduling(scheduling);
+            for (const auto &e : status.errors)
+                std::cerr << "Warning: output thread " << thread_name << ": " << e << std::endl;
+            std::cerr << "Output thread " << thread_name << " scheduling: " << status << std::endl;
+        }
+
+        thread_service.run();
+    }
+};
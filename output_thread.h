@@ -0,0 +1,106 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef OUTPUT_THREAD_H
+#define OUTPUT_THREAD_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+
+#include "modes_filter.h"
+#include "modes_message.h"
+#include "scheduling.h"
+
+namespace splitter {
+    // A thread of its own for outputs that must not wait behind the
+    // writes of everything else on the main io_service.
+    //
+    // The thread runs a separate io_service and FilterDistributor, and its
+    // listeners, connectors and outputs are created on those exactly as
+    // they would be on the main loop. The main distributor sees the whole
+    // thread as one client whose filter is the union of its outputs'
+    // filters; messages are copied across in batches, with one post per
+    // batch rather than per message.
+    class OutputThread {
+    public:
+        OutputThread(boost::asio::io_service &main_service,
+                     modes::FilterDistributor &main_distributor,
+                     const std::string &name,
+                     const SchedulingOptions &scheduling);
+        ~OutputThread();
+
+        OutputThread(const OutputThread &) = delete;
+        OutputThread &operator=(const OutputThread &) = delete;
+
+        const std::string &name() const {
+            return thread_name;
+        }
+
+        // Everything created on these must only be touched from the
+        // output thread, e.g. via service().post()
+        boost::asio::io_service &service() {
+            return thread_service;
+        }
+
+        modes::FilterDistributor &distributor() {
+            return thread_distributor;
+        }
+
+    private:
+        void deliver(const modes::Message &message);
+        void flush();
+        void run(SchedulingOptions scheduling);
+
+        boost::asio::io_service &main_service;
+        modes::FilterDistributor &main_distributor;
+        modes::FilterDistributor::handle main_handle;
+        std::string thread_name;
+
+        // declared in this order so that, as in main(), the distributor
+        // and the outputs it holds go before the io_service they use
+        boost::asio::io_service thread_service;
+        std::unique_ptr<boost::asio::io_service::work> work;
+        modes::FilterDistributor thread_distributor;
+
+        // messages from the main thread waiting for flush()
+        std::mutex mutex;
+        std::vector<modes::Message> pending;
+
+        // only used on the output thread
+        std::vector<modes::Message> delivering;
+
+        std::thread thread;
+    };
+};
+
+#endif
@@ -0,0 +1,528 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Training workload for "make pgo".
+//
+// Starts beast-splitter reading from a fake Radarcape-style receiver on a
+// local port, with a mix of listeners (Beast binary, AVR, JSON, CSV, SBS,
+// filtered, reordered) and a --connect output, and a client on each.
+// Traffic is replayed through it as fast as it will take it, then the
+// splitter is stopped with SIGTERM so an instrumented build writes its
+// profile.
+//
+// usage: pgo-train SPLITTER [CAPTURE]
+//
+// CAPTURE is a raw Beast binary capture, e.g. saved with
+// "nc receiver 30005 > capture.bin", and is repeated as needed. Without
+// one, synthetic traffic from a few hundred aircraft is generated.
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef std::vector<std::uint8_t> bytebuf;
+
+// how much to send, in messages for synthetic traffic or bytes for a capture
+static const unsigned synthetic_messages = 1000000;
+static const std::size_t capture_bytes = 24 * 1024 * 1024;
+
+static void fail(const std::string &what)
+{
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+//
+// Synthetic traffic
+//
+
+static std::uint32_t crc_table[256];
+
+static void init_crc_table()
+{
+    for (int i = 0; i < 256; ++i) {
+        std::uint32_t c = i << 16;
+        for (int j = 0; j < 8; ++j)
+            c = (c & 0x800000) ? ((c << 1) ^ 0xFFF409) : (c << 1);
+        crc_table[i] = c & 0xFFFFFF;
+    }
+}
+
+static std::uint32_t crc(const bytebuf &data, std::size_t len)
+{
+    std::uint32_t c = 0;
+    for (std::size_t i = 0; i < len; ++i)
+        c = ((c << 8) ^ crc_table[data[i] ^ ((c & 0xff0000) >> 16)]) & 0xFFFFFF;
+    return c;
+}
+
+static void set_parity(bytebuf &data, std::uint32_t overlay)
+{
+    std::uint32_t p = crc(data, data.size() - 3) ^ overlay;
+    data[data.size() - 3] = p >> 16;
+    data[data.size() - 2] = p >> 8;
+    data[data.size() - 1] = p;
+}
+
+// store 'bits' bits of 'value' starting at bit 'first' (1-based, as in
+// the ICAO documents) of data
+static void put_bits(bytebuf &data, unsigned first, unsigned bits, std::uint32_t value)
+{
+    for (unsigned i = 0; i < bits; ++i) {
+        unsigned bit = first - 1 + i;
+        if (value & (1U << (bits - 1 - i)))
+            data[bit / 8] |= (0x80 >> (bit % 8));
+        else
+            data[bit / 8] &= ~(0x80 >> (bit % 8));
+    }
+}
+
+static int cpr_nl(double lat)
+{
+    if (std::fabs(lat) >= 87.0)
+        return 1;
+    const double nz = 15;
+    double a = 1 - std::cos(M_PI / (2 * nz));
+    double b = std::pow(std::cos(M_PI / 180.0 * std::fabs(lat)), 2);
+    return (int) std::floor(2 * M_PI / std::acos(1 - a / b));
+}
+
+static void cpr_encode(double lat, double lon, int odd, std::uint32_t &yz, std::uint32_t &xz)
+{
+    double dlat = 360.0 / (60 - odd);
+    double y = std::floor(131072 * std::fmod(lat + 360, dlat) / dlat + 0.5);
+    double rlat = dlat * (y / 131072 + std::floor(lat / dlat));
+    int nl = cpr_nl(rlat) - odd;
+    double dlon = 360.0 / (nl > 1 ? nl : 1);
+    double x = std::floor(131072 * std::fmod(lon + 360, dlon) / dlon + 0.5);
+    yz = (std::uint32_t) y & 0x1FFFF;
+    xz = (std::uint32_t) x & 0x1FFFF;
+}
+
+struct Aircraft {
+    std::uint32_t address;
+    double lat, lon;
+    int altitude;
+    int squawk;
+    int odd;
+};
+
+class SyntheticTraffic {
+public:
+    SyntheticTraffic()
+        : rng(12345), timestamp(0), next_status(0)
+    {
+        std::uniform_real_distribution<double> dlat(36.0, 39.0), dlon(-123.5, -120.5);
+        std::uniform_int_distribution<int> dalt(0, 1600), dsquawk(0, 07777);
+        for (int i = 0; i < 300; ++i)
+            aircraft.push_back({ 0xA00000U + i * 0x1F3U, dlat(rng), dlon(rng), dalt(rng) * 25, dsquawk(rng), 0 });
+    }
+
+    // append one or more Beast frames to out
+    void generate(bytebuf &out) {
+        timestamp += std::uniform_int_distribution<int>(0, 12000)(rng);
+
+        if (timestamp >= next_status) {
+            // binary format, RTS, Mode A/C on, 12MHz timestamps
+            bytebuf status(14, 0);
+            status[0] = 0xA1;
+            frame(out, '4', status);
+            next_status = timestamp + 12000000;
+        }
+
+        Aircraft &a = aircraft[std::uniform_int_distribution<std::size_t>(0, aircraft.size() - 1)(rng)];
+        a.lat += 0.0001;
+        a.lon += 0.0001;
+
+        int kind = std::uniform_int_distribution<int>(0, 99)(rng);
+        bytebuf data;
+        if (kind < 5) {
+            // Mode A/C
+            data = { (std::uint8_t) (a.squawk >> 8), (std::uint8_t) a.squawk };
+            frame(out, '1', data);
+            return;
+        } else if (kind < 25) {
+            data = es(a, 11);
+            std::uint32_t yz, xz;
+            cpr_encode(a.lat, a.lon, a.odd, yz, xz);
+            int n = (a.altitude + 1000) / 25;
+            put_bits(data, 41, 12, ((n & 0x7F0) << 1) | 0x10 | (n & 0x0F));
+            put_bits(data, 54, 1, a.odd);
+            put_bits(data, 55, 17, yz);
+            put_bits(data, 72, 17, xz);
+            a.odd ^= 1;
+        } else if (kind < 40) {
+            data = es(a, 19);
+            put_bits(data, 38, 3, 1);
+            put_bits(data, 46, 11, std::uniform_int_distribution<int>(0, 500)(rng));
+            put_bits(data, 57, 11, std::uniform_int_distribution<int>(0, 500)(rng));
+            put_bits(data, 69, 10, std::uniform_int_distribution<int>(0, 100)(rng));
+        } else if (kind < 45) {
+            data = es(a, 4);
+            for (unsigned i = 0; i < 8; ++i)
+                put_bits(data, 41 + i * 6, 6, std::uniform_int_distribution<int>(1, 26)(rng));
+        } else if (kind < 47) {
+            data = es(a, 6);
+        } else if (kind < 62) {
+            // DF11 all-call reply
+            data = bytebuf(7, 0);
+            data[0] = (11 << 3) | 5;
+            put_bits(data, 9, 24, a.address);
+            set_parity(data, 0);
+        } else if (kind < 72) {
+            data = surveillance(4, 7, a.altitude / 25, a.address);
+        } else if (kind < 80) {
+            data = surveillance(5, 7, a.squawk, a.address);
+        } else if (kind < 88) {
+            data = surveillance(20, 14, a.altitude / 25, a.address);
+        } else if (kind < 95) {
+            data = surveillance(21, 14, a.squawk, a.address);
+        } else {
+            data = surveillance(0, 7, a.altitude / 25, a.address);
+        }
+
+        // a few damaged messages
+        if (std::uniform_int_distribution<int>(0, 49)(rng) == 0)
+            data[std::uniform_int_distribution<std::size_t>(0, data.size() - 1)(rng)] ^= 0x10;
+
+        frame(out, data.size() == 7 ? '2' : '3', data);
+    }
+
+private:
+    bytebuf es(const Aircraft &a, int typecode) {
+        bytebuf data(14, 0);
+        for (auto &b : data)
+            b = std::uniform_int_distribution<int>(0, 255)(rng);
+        data[0] = (17 << 3) | 5;
+        put_bits(data, 9, 24, a.address);
+        put_bits(data, 33, 5, typecode);
+        set_parity(data, 0);
+        return data;
+    }
+
+    bytebuf surveillance(int df, std::size_t len, int field, std::uint32_t address) {
+        bytebuf data(len, 0);
+        for (auto &b : data)
+            b = std::uniform_int_distribution<int>(0, 255)(rng);
+        put_bits(data, 1, 5, df);
+        put_bits(data, 6, 3, 0);
+        put_bits(data, 20, 13, field & 0x1FFF);
+        set_parity(data, address);
+        return data;
+    }
+
+    void frame(bytebuf &out, char type, const bytebuf &data) {
+        bytebuf body;
+        for (int i = 5; i >= 0; --i)
+            body.push_back(timestamp >> (i * 8));
+        body.push_back(std::uniform_int_distribution<int>(20, 255)(rng));
+        body.insert(body.end(), data.begin(), data.end());
+
+        out.push_back(0x1A);
+        out.push_back(type);
+        for (auto b : body) {
+            if (b == 0x1A)
+                out.push_back(0x1A);
+            out.push_back(b);
+        }
+    }
+
+    std::mt19937 rng;
+    std::uint64_t timestamp;
+    std::uint64_t next_status;
+    std::vector<Aircraft> aircraft;
+};
+
+//
+// Sockets
+//
+
+static int listen_local(int &port)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        fail("socket");
+
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(fd, 5) < 0)
+        fail("bind");
+
+    socklen_t len = sizeof(addr);
+    ::getsockname(fd, (sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+// a port that was free a moment ago, for the splitter to listen on
+static int free_port()
+{
+    int port = 0;
+    ::close(listen_local(port));
+    return port;
+}
+
+static int accept_within(int listener, int timeout_ms)
+{
+    pollfd p = { listener, POLLIN, 0 };
+    if (::poll(&p, 1, timeout_ms) <= 0)
+        throw std::runtime_error("timed out waiting for beast-splitter to connect");
+    int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0)
+        fail("accept");
+    return fd;
+}
+
+static int connect_local(int port)
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    // the splitter may still be starting up
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            fail("socket");
+        if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+            ::fcntl(fd, F_SETFL, O_NONBLOCK);
+            return fd;
+        }
+        ::close(fd);
+        ::usleep(100000);
+    }
+
+    fail("connect to port " + std::to_string(port));
+    return -1;
+}
+
+//
+// The workload
+//
+
+struct Client {
+    std::string spec;
+    int port;
+    int fd;
+    std::size_t received;
+};
+
+// Send everything, reading from every client as we go, then stop the
+// splitter once its output has gone quiet. Whatever it writes back to
+// the receiver is read and discarded.
+static std::size_t replay(pid_t pid, int input, std::vector<Client> &clients, const bytebuf &traffic)
+{
+    std::size_t sent = 0;
+    bool stopping = false;
+    std::vector<std::uint8_t> buf(65536);
+
+    for (;;) {
+        std::vector<pollfd> fds;
+        fds.push_back({ input, (short) (POLLIN | (sent < traffic.size() ? POLLOUT : 0)), 0 });
+        for (const auto &c : clients)
+            fds.push_back({ c.fd, POLLIN, 0 });
+
+        int n = ::poll(fds.data(), fds.size(), 1000);
+        if (n < 0 && errno != EINTR)
+            fail("poll");
+        if (n == 0 && sent >= traffic.size()) {
+            if (stopping)
+                break;
+            ::kill(pid, SIGTERM);
+            stopping = true;
+            continue;
+        }
+
+        if (fds[0].revents & POLLOUT) {
+            ssize_t w = ::write(input, traffic.data() + sent, std::min<std::size_t>(traffic.size() - sent, 65536));
+            if (w < 0 && errno != EAGAIN)
+                fail("write to beast-splitter");
+            if (w > 0)
+                sent += w;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t r = ::read(input, buf.data(), buf.size());
+            if (r == 0 || (r < 0 && errno != EAGAIN)) {
+                if (!stopping)
+                    throw std::runtime_error("beast-splitter closed the receiver connection");
+                ::close(input);
+                input = -1;
+            }
+        }
+
+        bool any_open = false;
+        for (std::size_t i = 0; i < clients.size(); ++i) {
+            Client &c = clients[i];
+            if (c.fd < 0)
+                continue;
+            if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t r = ::read(c.fd, buf.data(), buf.size());
+                if (r > 0) {
+                    c.received += r;
+                } else if (r == 0 || errno != EAGAIN) {
+                    ::close(c.fd);
+                    c.fd = -1;
+                    continue;
+                }
+            }
+            any_open = true;
+        }
+
+        if (stopping && !any_open)
+            break;
+    }
+
+    return sent;
+}
+
+static int run(const std::string &splitter, const std::string &capture)
+{
+    bytebuf traffic;
+    if (capture.empty()) {
+        init_crc_table();
+        SyntheticTraffic synthetic;
+        for (unsigned i = 0; i < synthetic_messages; ++i)
+            synthetic.generate(traffic);
+    } else {
+        std::ifstream in(capture, std::ios::binary);
+        bytebuf once((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (once.empty())
+            throw std::runtime_error("could not read " + capture);
+        while (traffic.size() < capture_bytes)
+            traffic.insert(traffic.end(), once.begin(), once.end());
+    }
+
+    int input_port = 0, sink_port = 0;
+    int input_listener = listen_local(input_port);
+    int sink_listener = listen_local(sink_port);
+
+    std::vector<Client> clients;
+    for (const char *options : { ":C", ":cE", ":ce", ":CJ:format=json", ":C:format=csv", ":C:format=sbs",
+                                 ":CJF:df=0,4,5,11,17:tc=9-18:rate-limit=2", ":C:reorder=50:nodelay" }) {
+        int port = free_port();
+        clients.push_back({ "127.0.0.1:" + std::to_string(port) + options, port, -1, 0 });
+    }
+
+    char status_dir[] = "/tmp/pgo-train.XXXXXX";
+    if (!::mkdtemp(status_dir))
+        fail("mkdtemp");
+    const std::string status_file = std::string(status_dir) + "/status.json";
+
+    std::vector<std::string> args = { splitter,
+                                      "--net", "127.0.0.1:" + std::to_string(input_port),
+                                      "--connect", "127.0.0.1:" + std::to_string(sink_port) + ":C:nodelay",
+                                      "--status-file", status_file };
+    for (const auto &c : clients) {
+        args.push_back("--listen");
+        args.push_back(c.spec);
+    }
+
+    pid_t pid = ::fork();
+    if (pid < 0)
+        fail("fork");
+    if (pid == 0) {
+        std::vector<char*> argv;
+        for (auto &a : args)
+            argv.push_back(&a[0]);
+        argv.push_back(nullptr);
+        ::execv(argv[0], argv.data());
+        std::cerr << "pgo-train: could not run " << splitter << ": " << std::strerror(errno) << std::endl;
+        ::_exit(127);
+    }
+
+    std::size_t sent;
+    try {
+        int input = accept_within(input_listener, 10000);
+        for (auto &c : clients)
+            c.fd = connect_local(c.port);
+        clients.push_back({ "connect", sink_port, accept_within(sink_listener, 10000), 0 });
+
+        sent = replay(pid, input, clients, traffic);
+    } catch (...) {
+        ::kill(pid, SIGKILL);
+        ::waitpid(pid, nullptr, 0);
+        ::unlink(status_file.c_str());
+        ::rmdir(status_dir);
+        throw;
+    }
+
+    int status;
+    ::waitpid(pid, &status, 0);
+    ::unlink(status_file.c_str());
+    ::rmdir(status_dir);
+
+    std::cerr << "pgo-train: sent " << sent << " bytes of " << (capture.empty() ? "synthetic traffic" : capture) << std::endl;
+    for (const auto &c : clients)
+        std::cerr << "pgo-train:   " << c.spec << " received " << c.received << " bytes" << std::endl;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "pgo-train: beast-splitter did not exit cleanly" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " SPLITTER [CAPTURE]" << std::endl;
+        return 2;
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+
+    try {
+        return run(argv[1], argc > 2 ? argv[2] : "");
+    } catch (const std::exception &e) {
+        std::cerr << "pgo-train: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,547 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <limits>
+
+#include "sbs_encoder.h"
+#include "modes_address_set.h"
+
+namespace sbs {
+    const std::uint32_t Encoder::empty;
+
+    // marks an integer field that is not present
+    static const int absent = std::numeric_limits<int>::min();
+
+    struct Encoder::Fields {
+        int type;               // SBS transmission type, 1-8
+        std::uint32_t address;
+        char callsign[9];       // empty if not present
+        int altitude;           // feet
+        int speed;              // knots
+        int track;              // degrees
+        bool position;
+        double lat, lon;
+        int vertical_rate;      // feet/minute
+        int squawk;             // one octal digit per nibble
+        int alert, emergency, spi, ground; // 1, 0, or -1 if unknown
+    };
+
+    Encoder::Encoder()
+        : keys(256, empty),
+          aircraft(256),
+          mask(255),
+          count(0),
+          cached_valid(false),
+          cached_time(-1)
+    {}
+
+    //////////////
+
+    std::size_t Encoder::lookup(std::uint32_t address) const
+    {
+        std::uint32_t i = modes::address_hash(address) & mask;
+        while (keys[i] != address && keys[i] != empty)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    Encoder::Aircraft &Encoder::insert(std::uint32_t address, clock::time_point now)
+    {
+        if ((count + 1) * 2 > keys.size()) {
+            // make room by forgetting stale aircraft before growing
+            for (std::size_t i = 0; i < keys.size(); ) {
+                if (keys[i] != empty && (now - aircraft[i].last_seen) > expire_interval) {
+                    // erase() may move a later entry into slot i, so look at it again
+                    erase(i);
+                } else {
+                    ++i;
+                }
+            }
+
+            if ((count + 1) * 2 > keys.size())
+                rehash(keys.size() * 2);
+        }
+
+        std::size_t i = lookup(address);
+        keys[i] = address;
+        ++count;
+
+        Aircraft &a = aircraft[i];
+        a.last_seen = now;
+        a.cpr_time[0] = a.cpr_time[1] = clock::time_point();
+        return a;
+    }
+
+    void Encoder::erase(std::size_t i)
+    {
+        // backward-shift deletion, as in AircraftTable
+        std::size_t j = i;
+        for (;;) {
+            j = (j + 1) & mask;
+            if (keys[j] == empty)
+                break;
+
+            std::size_t home = modes::address_hash(keys[j]) & mask;
+            bool stays = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stays) {
+                keys[i] = keys[j];
+                aircraft[i] = aircraft[j];
+                i = j;
+            }
+        }
+
+        keys[i] = empty;
+        --count;
+    }
+
+    void Encoder::rehash(std::size_t new_size)
+    {
+        std::vector<std::uint32_t> old_keys(new_size, empty);
+        std::vector<Aircraft> old_aircraft(new_size);
+        old_keys.swap(keys);
+        old_aircraft.swap(aircraft);
+        mask = new_size - 1;
+
+        for (std::size_t j = 0; j < old_keys.size(); ++j) {
+            if (old_keys[j] == empty)
+                continue;
+
+            std::size_t i = lookup(old_keys[j]);
+            keys[i] = old_keys[j];
+            aircraft[i] = old_aircraft[j];
+        }
+    }
+
+    //////////////
+
+    // Gillham (Mode C) altitude from a Mode A style code (one octal digit
+    // per nibble, as returned by modes::decode_id13), in feet
+    static int gillham_altitude(int code)
+    {
+        // the high bit of each digit and D1 must be zero; some C bit must be set
+        if ((code & 0x8889) != 0 || (code & 0x00F0) == 0)
+            return absent;
+
+        int hundreds = 0;
+        if (code & 0x0010) hundreds ^= 7; // C1
+        if (code & 0x0020) hundreds ^= 3; // C2
+        if (code & 0x0040) hundreds ^= 1; // C4
+        if ((hundreds & 5) == 5)
+            hundreds ^= 2;
+        if (hundreds > 5)
+            return absent;
+
+        int five_hundreds = 0;
+        if (code & 0x0002) five_hundreds ^= 0x0FF; // D2
+        if (code & 0x0004) five_hundreds ^= 0x07F; // D4
+        if (code & 0x1000) five_hundreds ^= 0x03F; // A1
+        if (code & 0x2000) five_hundreds ^= 0x01F; // A2
+        if (code & 0x4000) five_hundreds ^= 0x00F; // A4
+        if (code & 0x0100) five_hundreds ^= 0x007; // B1
+        if (code & 0x0200) five_hundreds ^= 0x003; // B2
+        if (code & 0x0400) five_hundreds ^= 0x001; // B4
+
+        if (five_hundreds & 1)
+            hundreds = 6 - hundreds;
+
+        return (five_hundreds * 5 + hundreds - 13) * 100;
+    }
+
+    // 13-bit AC field of DF0/4/16/20
+    static int decode_ac13(int ac13)
+    {
+        if (ac13 == 0 || (ac13 & 0x0040))
+            return absent; // unknown, or metric
+
+        if (ac13 & 0x0010) {
+            // 25ft encoding
+            int n = ((ac13 & 0x1F80) >> 2) | ((ac13 & 0x0020) >> 1) | (ac13 & 0x000F);
+            return n * 25 - 1000;
+        }
+
+        return gillham_altitude(modes::decode_id13(ac13));
+    }
+
+    // 12-bit altitude field of an airborne position extended squitter
+    static int decode_ac12(int ac12)
+    {
+        if (ac12 == 0)
+            return absent;
+
+        if (ac12 & 0x0010) {
+            int n = ((ac12 & 0x0FE0) >> 1) | (ac12 & 0x000F);
+            return n * 25 - 1000;
+        }
+
+        // reinsert the M bit to get an AC13 Gillham code
+        return gillham_altitude(modes::decode_id13(((ac12 & 0x0FC0) << 1) | (ac12 & 0x003F)));
+    }
+
+    // ground speed in knots from the surface position movement field
+    static int decode_movement(int movement)
+    {
+        double speed;
+        if (movement == 0 || movement > 124)
+            return absent;
+        else if (movement == 124)
+            speed = 175;
+        else if (movement >= 109)
+            speed = 100 + (movement - 108) * 5;
+        else if (movement >= 94)
+            speed = 70 + (movement - 93) * 2;
+        else if (movement >= 39)
+            speed = 15 + (movement - 38);
+        else if (movement >= 13)
+            speed = 2 + (movement - 12) * 0.5;
+        else if (movement >= 9)
+            speed = 1 + (movement - 8) * 0.25;
+        else
+            speed = (movement - 1) * 0.125;
+        return (int) std::lround(speed);
+    }
+
+    // number of CPR longitude zones at a given latitude
+    static int cpr_nl(double lat)
+    {
+        lat = std::fabs(lat);
+        if (lat == 0)
+            return 59;
+        if (lat == 87)
+            return 2;
+        if (lat > 87)
+            return 1;
+
+        const double a = 1 - std::cos(M_PI / 30);
+        double b = std::cos(M_PI / 180 * lat);
+        return (int) std::floor(2 * M_PI / std::acos(1 - a / (b * b)));
+    }
+
+    static int cpr_mod(int a, int b)
+    {
+        int r = a % b;
+        return (r < 0 ? r + b : r);
+    }
+
+    // Global airborne CPR decode of an even/odd pair; 'odd' says which of
+    // the two is the most recent. Returns false if the pair is inconsistent.
+    static bool decode_cpr_airborne(const std::uint32_t lat_cpr[2], const std::uint32_t lon_cpr[2], int odd,
+                                    double &lat, double &lon)
+    {
+        const double scale = 131072.0;
+        double lat0 = lat_cpr[0], lat1 = lat_cpr[1];
+        double lon0 = lon_cpr[0], lon1 = lon_cpr[1];
+
+        int j = (int) std::floor((59 * lat0 - 60 * lat1) / scale + 0.5);
+        double rlat0 = 360.0 / 60 * (cpr_mod(j, 60) + lat0 / scale);
+        double rlat1 = 360.0 / 59 * (cpr_mod(j, 59) + lat1 / scale);
+        if (rlat0 >= 270) rlat0 -= 360;
+        if (rlat1 >= 270) rlat1 -= 360;
+
+        if (rlat0 < -90 || rlat0 > 90 || rlat1 < -90 || rlat1 > 90)
+            return false;
+
+        int nl = cpr_nl(rlat0);
+        if (nl != cpr_nl(rlat1))
+            return false; // the pair straddles a zone boundary
+
+        int ni = nl - odd;
+        if (ni < 1)
+            ni = 1;
+        int m = (int) std::floor((lon0 * (nl - 1) - lon1 * nl) / scale + 0.5);
+
+        lat = (odd ? rlat1 : rlat0);
+        lon = 360.0 / ni * (cpr_mod(m, ni) + (odd ? lon1 : lon0) / scale);
+        lon -= std::floor((lon + 180) / 360) * 360;
+        return true;
+    }
+
+    // flight status field of DF4/5/20/21
+    static void decode_flight_status(int fs, int &alert, int &spi, int &ground)
+    {
+        alert = (fs >= 2 && fs <= 4);
+        spi = (fs == 4 || fs == 5);
+        if (fs == 0 || fs == 2)
+            ground = 0;
+        else if (fs == 1 || fs == 3)
+            ground = 1;
+    }
+
+    //////////////
+
+    bool Encoder::decode_position(Aircraft &a, const modes::Message &message, Fields &f)
+    {
+        const auto &data = message.data();
+        clock::time_point now = a.last_seen;
+
+        int odd = (data[6] >> 2) & 1;
+        a.cpr_lat[odd] = ((data[6] & 0x03) << 15) | (data[7] << 7) | (data[8] >> 1);
+        a.cpr_lon[odd] = ((data[8] & 0x01) << 16) | (data[9] << 8) | data[10];
+        a.cpr_time[odd] = now;
+
+        clock::time_point other = a.cpr_time[odd ^ 1];
+        if (other == clock::time_point() || (now - other) > cpr_max_interval)
+            return false;
+
+        f.position = decode_cpr_airborne(a.cpr_lat, a.cpr_lon, odd, f.lat, f.lon);
+        return f.position;
+    }
+
+    bool Encoder::decode(const modes::Message &message, Fields &f)
+    {
+        f.type = 0;
+        f.callsign[0] = 0;
+        f.altitude = f.speed = f.track = f.vertical_rate = f.squawk = absent;
+        f.position = false;
+        f.alert = f.emergency = f.spi = f.ground = -1;
+
+        int df = message.df();
+        int address = message.address();
+        if (address < 0)
+            return false;
+        f.address = address;
+
+        clock::time_point now = message.received();
+        if (now == clock::time_point())
+            now = clock::now();
+
+        Aircraft *a;
+        switch (df) {
+        case 11:
+        case 17:
+        case 18: {
+            if (message.crc_bad())
+                return false;
+
+            std::size_t i = lookup(address);
+            if (keys[i] == empty) {
+                a = &insert(address, now);
+            } else {
+                a = &aircraft[i];
+                a->last_seen = now;
+            }
+            break;
+        }
+
+        case 4:
+        case 5:
+        case 20:
+        case 21: {
+            // only believe an AP-derived address if we know the aircraft
+            std::size_t i = lookup(address);
+            if (keys[i] == empty || (now - aircraft[i].last_seen) > expire_interval)
+                return false;
+            a = &aircraft[i];
+            break;
+        }
+
+        default:
+            return false;
+        }
+
+        const auto &data = message.data();
+        switch (df) {
+        case 4:
+        case 20:
+            f.type = 5;
+            f.altitude = decode_ac13(((data[2] << 8) | data[3]) & 0x1FFF);
+            decode_flight_status(data[0] & 7, f.alert, f.spi, f.ground);
+            return true;
+
+        case 5:
+        case 21:
+            f.type = 6;
+            f.squawk = message.squawk();
+            f.emergency = (f.squawk == 0x7500 || f.squawk == 0x7600 || f.squawk == 0x7700);
+            decode_flight_status(data[0] & 7, f.alert, f.spi, f.ground);
+            return true;
+
+        case 11:
+            f.type = 8;
+            // capability field: 4 = on the ground, 5 = airborne
+            if ((data[0] & 7) == 4)
+                f.ground = 1;
+            else if ((data[0] & 7) == 5)
+                f.ground = 0;
+            return true;
+        }
+
+        // DF17/18
+        int tc = message.typecode();
+        if (tc >= 1 && tc <= 4) {
+            static const char *charset = "#ABCDEFGHIJKLMNOPQRSTUVWXYZ##### ###############0123456789######";
+            std::uint64_t bits = 0;
+            for (int i = 5; i <= 10; ++i)
+                bits = (bits << 8) | data[i];
+
+            int len = 0;
+            for (int i = 0; i < 8; ++i) {
+                char c = charset[(bits >> (42 - 6 * i)) & 0x3F];
+                if (c == '#')
+                    return false;
+                f.callsign[i] = c;
+                if (c != ' ')
+                    len = i + 1;
+            }
+            f.callsign[len] = 0;
+            f.type = 1;
+            return true;
+        }
+
+        if (tc >= 5 && tc <= 8) {
+            f.type = 2;
+            f.ground = 1;
+            f.speed = decode_movement(((data[4] & 0x07) << 4) | (data[5] >> 4));
+            if (data[5] & 0x08)
+                f.track = (int) std::lround((((data[5] & 0x07) << 4) | (data[6] >> 4)) * 360.0 / 128) % 360;
+            return true;
+        }
+
+        if ((tc >= 9 && tc <= 18) || (tc >= 20 && tc <= 22)) {
+            f.type = 3;
+            f.ground = 0;
+            // TC 20-22 carry GNSS height, which is not what SBS consumers expect here
+            if (tc <= 18)
+                f.altitude = decode_ac12((data[5] << 4) | (data[6] >> 4));
+            decode_position(*a, message, f);
+            return true;
+        }
+
+        if (tc == 19) {
+            int subtype = data[4] & 0x07;
+            if (subtype < 1 || subtype > 4)
+                return false;
+
+            f.type = 4;
+            if (subtype <= 2) {
+                int ew_raw = ((data[5] & 0x03) << 8) | data[6];
+                int ns_raw = ((data[7] & 0x7F) << 3) | (data[8] >> 5);
+                if (ew_raw && ns_raw) {
+                    int factor = (subtype == 2 ? 4 : 1);
+                    double ew = (ew_raw - 1) * factor * ((data[5] & 0x04) ? -1 : 1);
+                    double ns = (ns_raw - 1) * factor * ((data[7] & 0x80) ? -1 : 1);
+                    f.speed = (int) std::lround(std::sqrt(ew * ew + ns * ns));
+                    double track = std::atan2(ew, ns) * 180 / M_PI;
+                    if (track < 0)
+                        track += 360;
+                    f.track = (int) std::lround(track) % 360;
+                }
+            }
+
+            int vr_raw = ((data[8] & 0x07) << 6) | (data[9] >> 2);
+            if (vr_raw)
+                f.vertical_rate = (vr_raw - 1) * 64 * ((data[8] & 0x08) ? -1 : 1);
+            return true;
+        }
+
+        return false;
+    }
+
+    //////////////
+
+    static void put_field(helpers::TextBuffer &line, int v)
+    {
+        line.put(',');
+        if (v != absent)
+            line.put_int(v);
+    }
+
+    static void put_flag(helpers::TextBuffer &line, int v)
+    {
+        line.put(',');
+        if (v >= 0)
+            line.put(v ? "-1" : "0");
+    }
+
+    // MSG,type,1,1,HEXID,1,date,time,date,time,callsign,altitude,speed,track,lat,lon,vrate,squawk,alert,emergency,spi,ground
+    void Encoder::format(const Fields &f)
+    {
+        auto now = std::chrono::system_clock::now();
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+        std::time_t t = std::chrono::system_clock::to_time_t(now);
+
+        // localtime_r is comparatively slow, so only do it once a second
+        if (t != cached_time) {
+            struct tm tm;
+            localtime_r(&t, &tm);
+            cached_datetime.clear();
+            cached_datetime.put_uint(tm.tm_year + 1900, 4).put('/')
+                .put_uint(tm.tm_mon + 1, 2).put('/')
+                .put_uint(tm.tm_mday, 2).put(',')
+                .put_uint(tm.tm_hour, 2).put(':')
+                .put_uint(tm.tm_min, 2).put(':')
+                .put_uint(tm.tm_sec, 2).put('.');
+            cached_time = t;
+        }
+
+        line.put("MSG,").put_uint(f.type).put(",1,1,").put_hex(f.address, 6, true).put(",1,");
+        line.put(cached_datetime).put_uint(ms, 3).put(',');
+        line.put(cached_datetime).put_uint(ms, 3).put(',');
+        line.put(f.callsign);
+        put_field(line, f.altitude);
+        put_field(line, f.speed);
+        put_field(line, f.track);
+        if (f.position) {
+            line.put(',').put_fixed(f.lat, 5);
+            line.put(',').put_fixed(f.lon, 5);
+        } else {
+            line.put(",,");
+        }
+        put_field(line, f.vertical_rate);
+        line.put(',');
+        if (f.squawk != absent)
+            line.put_hex(f.squawk, 4);
+        put_flag(line, f.alert);
+        put_flag(line, f.emergency);
+        put_flag(line, f.spi);
+        put_flag(line, f.ground);
+        line.put("\r\n");
+    }
+
+    bool Encoder::same_as_cached(const modes::Message &message) const
+    {
+        return (cached_valid &&
+                message.type() == cached_message.type() &&
+                message.timestamp() == cached_message.timestamp() &&
+                message.received() == cached_message.received() &&
+                message.data() == cached_message.data());
+    }
+
+    void Encoder::render(const modes::Message &message, helpers::bytebuf &out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!same_as_cached(message)) {
+            cached_message = message;
+            cached_valid = true;
+
+            line.clear();
+            Fields fields;
+            if (decode(message, fields))
+                format(fields);
+        }
+
+        line.append_to(out);
+    }
+};
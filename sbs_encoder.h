@@ -0,0 +1,112 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SBS_ENCODER_H
+#define SBS_ENCODER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+#include "helpers.h"
+#include "modes_message.h"
+
+namespace sbs {
+    // Renders Mode S messages as BaseStation ("SBS", port 30003) text
+    // lines.
+    //
+    // One Encoder is shared by every client using this format. The last
+    // message rendered and its line are cached, so when the same message
+    // is written to several clients it is only decoded and formatted once.
+    // Lines are built in a fixed buffer without iostreams.
+    //
+    // Airborne positions are decoded globally from an even/odd CPR pair,
+    // so the encoder keeps a little state per aircraft. Addresses
+    // recovered from the AP field (DF0/4/5/16/20/21) are only trusted if
+    // the aircraft has recently been seen in a DF11/17/18 message with a
+    // good CRC.
+    class Encoder {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        // CPR pairs further apart than this are not combined
+        const std::chrono::milliseconds cpr_max_interval = std::chrono::seconds(10);
+
+        // aircraft not heard from for this long may be forgotten
+        const std::chrono::milliseconds expire_interval = std::chrono::seconds(60);
+
+        Encoder();
+
+        // Render a message, appending its line (if it has an SBS
+        // representation) to 'out'. Safe to call from several threads.
+        void render(const modes::Message &message, helpers::bytebuf &out);
+
+    private:
+        struct Aircraft {
+            clock::time_point last_seen;
+            clock::time_point cpr_time[2];   // even, odd
+            std::uint32_t cpr_lat[2];
+            std::uint32_t cpr_lon[2];
+        };
+
+        // decoded fields of one line
+        struct Fields;
+
+        static const std::uint32_t empty = 0xFFFFFFFF;
+
+        bool same_as_cached(const modes::Message &message) const;
+        bool decode(const modes::Message &message, Fields &fields);
+        bool decode_position(Aircraft &a, const modes::Message &message, Fields &fields);
+        void format(const Fields &fields);
+
+        std::size_t lookup(std::uint32_t address) const;
+        Aircraft &insert(std::uint32_t address, clock::time_point now);
+        void erase(std::size_t i);
+        void rehash(std::size_t new_size);
+
+        std::vector<std::uint32_t> keys;
+        std::vector<Aircraft> aircraft;
+        std::uint32_t mask;
+        std::size_t count;
+
+        // guards all mutable state; render() may be called from encoder threads
+        std::mutex mutex;
+
+        // the last message rendered, and the result
+        modes::Message cached_message;
+        bool cached_valid;
+        helpers::TextBuffer line;
+
+        // the date and time (to the second) of the last line
+        std::time_t cached_time;
+        helpers::TextBuffer cached_datetime;
+    };
+};
+
+#endif
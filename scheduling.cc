@@ -0,0 +1,101 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cerrno>
+#include <cstring>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "scheduling.h"
+
+namespace splitter {
+    static std::string error_message(const std::string &what)
+    {
+        return what + ": " + std::strerror(errno);
+    }
+
+    SchedulingStatus apply_scheduling(const SchedulingOptions &options)
+    {
+        SchedulingStatus status;
+        status.cpu = -1;
+        status.realtime_priority = 0;
+        status.memory_locked = false;
+
+        if (options.cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(options.cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) < 0)
+                status.errors.push_back(error_message("could not pin to CPU " + std::to_string(options.cpu)));
+            else
+                status.cpu = options.cpu;
+        }
+
+        // on Linux, setpriority on PRIO_PROCESS 0 only affects the calling thread
+        if (options.set_nice && setpriority(PRIO_PROCESS, 0, options.nice) < 0)
+            status.errors.push_back(error_message("could not set nice value " + std::to_string(options.nice)));
+
+        errno = 0;
+        status.nice = getpriority(PRIO_PROCESS, 0);
+
+        if (options.realtime_priority > 0) {
+            struct sched_param param;
+            std::memset(&param, 0, sizeof(param));
+            param.sched_priority = options.realtime_priority;
+            if (sched_setscheduler(0, SCHED_FIFO, &param) < 0)
+                status.errors.push_back(error_message("could not set SCHED_FIFO priority " + std::to_string(options.realtime_priority)));
+            else
+                status.realtime_priority = options.realtime_priority;
+        }
+
+        if (options.lock_memory) {
+            if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+                status.errors.push_back(error_message("could not lock memory"));
+            else
+                status.memory_locked = true;
+        }
+
+        return status;
+    }
+
+    std::ostream &operator<<(std::ostream &os, const SchedulingStatus &status)
+    {
+        if (status.cpu >= 0)
+            os << "pinned to CPU " << status.cpu;
+        else
+            os << "not pinned";
+
+        if (status.realtime_priority > 0)
+            os << ", SCHED_FIFO priority " << status.realtime_priority;
+        else
+            os << ", normal scheduling";
+
+        os << ", nice " << status.nice
+           << ", memory " << (status.memory_locked ? "locked" : "not locked");
+        return os;
+    }
+};
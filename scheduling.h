@@ -0,0 +1,85 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SCHEDULING_H
+#define SCHEDULING_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace splitter {
+    // CPU affinity, priority and memory locking for the receive path.
+    //
+    // beast-splitter does all its work on a single asio thread, so these
+    // apply to that thread (and are inherited by any thread it starts).
+    // Memory locking always applies to the whole process.
+    struct SchedulingOptions {
+        SchedulingOptions()
+            : cpu(-1),
+              realtime_priority(0),
+              nice(0),
+              set_nice(false),
+              lock_memory(false)
+        {}
+
+        // pin to this CPU, or -1 to leave the affinity alone
+        int cpu;
+
+        // SCHED_FIFO priority (1-99), or 0 to keep normal scheduling
+        int realtime_priority;
+
+        // nice value to use, if set_nice is set
+        int nice;
+        bool set_nice;
+
+        // lock current and future memory with mlockall
+        bool lock_memory;
+
+        bool any() const {
+            return cpu >= 0 || realtime_priority > 0 || set_nice || lock_memory;
+        }
+    };
+
+    // what apply_scheduling actually managed to do
+    struct SchedulingStatus {
+        int cpu;                // pinned CPU, or -1
+        int realtime_priority;  // SCHED_FIFO priority, or 0
+        int nice;
+        bool memory_locked;
+        std::vector<std::string> errors;
+    };
+
+    // Apply the options to the calling thread. Failures (usually missing
+    // privileges) are recorded in the result rather than thrown, so the
+    // splitter still runs, just without the tuning.
+    SchedulingStatus apply_scheduling(const SchedulingOptions &options);
+
+    std::ostream &operator<<(std::ostream &os, const SchedulingStatus &status);
+};
+
+#endif
@@ -28,15 +28,39 @@
 #include "beast_input_net.h"
 #include "beast_output.h"
 #include "modes_filter.h"
+#include "modes_aircraft.h"
+#include "modes_signal_stats.h"
+#include "modes_clock_monitor.h"
 #include "status_writer.h"
+#include "scheduling.h"
+#include "control_socket.h"
+#include "handoff.h"
+#include "state_file.h"
+#include "output_thread.h"
+#include "cpu_dispatch.h"
 
 #include <boost/asio/ip/address_v4.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
 #include <boost/program_options.hpp>
 #include <boost/regex.hpp>
+#include <boost/version.hpp>
 
+#if defined(BOOST_ASIO_HAS_IO_URING) && BOOST_VERSION < 107800
+#error "the io_uring backend needs Boost 1.78 or later"
+#endif
+
+#ifdef BOOST_ASIO_HAS_IO_URING
+#include <boost/asio/detail/io_uring_service.hpp>
+#endif
+
+#include <map>
 #include <memory>
 #include <iostream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <unistd.h>
 
 namespace po = boost::program_options;
 using boost::asio::ip::tcp;
@@ -47,14 +71,148 @@ struct net_option {
 };
 
 struct output_option {
+    std::string spec;   // as given, for comparing configurations
     std::string host;
     std::string port;
     beast::Settings settings;
+    beast::OutputOptions options;
+    std::string thread; // --output-thread to run on, or empty for the main thread
+};
+
+struct output_thread_option {
+    std::string name;
+    splitter::SchedulingOptions scheduling;
 };
 
 struct listen_option : output_option {};
 struct connect_option : output_option {};
 
+// Parse a list of numbers and ranges in 0..31, e.g. "0,4-5,11", into a bitmask
+static std::uint32_t parse_bitmask(const std::string &key, const std::string &value)
+{
+    static const boost::regex r("(\\d{1,2})(?:-(\\d{1,2}))?");
+    std::uint32_t mask = 0;
+
+    std::size_t start = 0;
+    while (start <= value.size()) {
+        std::size_t end = value.find(',', start);
+        if (end == std::string::npos)
+            end = value.size();
+
+        std::string item = value.substr(start, end - start);
+        boost::smatch match;
+        if (!boost::regex_match(item, match, r))
+            throw po::error("bad " + key + " list '" + value + "'");
+
+        unsigned first = std::stoul(match[1]);
+        unsigned last = (match[2].matched ? std::stoul(match[2]) : first);
+        if (first > last || last > 31)
+            throw po::error("bad " + key + " list '" + value + "', values must be in the range 0-31");
+
+        for (unsigned i = first; i <= last; ++i)
+            mask |= (1U << i);
+
+        start = end + 1;
+    }
+
+    return mask;
+}
+
+// Parse the trailing ":key=value" part of a --listen / --connect option
+static void parse_output_options(const std::string &s, output_option &o)
+{
+    beast::OutputOptions &options = o.options;
+
+    std::size_t start = 0;
+    while (start < s.size()) {
+        // skip leading ':'
+        ++start;
+        std::size_t end = s.find(':', start);
+        if (end == std::string::npos)
+            end = s.size();
+
+        std::string item = s.substr(start, end - start);
+        std::string key = item, value;
+        std::size_t eq = item.find('=');
+        if (eq != std::string::npos) {
+            key = item.substr(0, eq);
+            value = item.substr(eq + 1);
+        }
+
+        try {
+            if (key == "icao-allow" && !value.empty()) {
+                options.address_allow = std::make_shared<modes::AddressSet>(modes::AddressSet::from_file(value));
+            } else if (key == "icao-deny" && !value.empty()) {
+                options.address_deny = std::make_shared<modes::AddressSet>(modes::AddressSet::from_file(value));
+            } else if (key == "df") {
+                options.df_mask = parse_bitmask(key, value);
+            } else if (key == "tc") {
+                options.typecode_mask = parse_bitmask(key, value);
+            } else if (key == "min-signal") {
+                static const boost::regex r("\\d{1,3}");
+                if (!boost::regex_match(value, r) || std::stoul(value) > 255)
+                    throw po::error("bad min-signal '" + value + "', expected 0-255");
+                options.min_signal = std::stoul(value);
+            } else if (key == "crc-good" && eq == std::string::npos) {
+                options.crc_good_only = true;
+            } else if (key == "rate-limit") {
+                // COUNT up to 999999, SECONDS up to 86400 with millisecond resolution
+                static const boost::regex r("(\\d{1,6})(?:/(\\d{1,5})(?:\\.(\\d{0,3}))?)?");
+                boost::smatch match;
+                if (!boost::regex_match(value, match, r) || std::stoul(match[1]) == 0)
+                    throw po::error("bad rate-limit '" + value + "', expected COUNT[/SECONDS]");
+                options.rate_limit_count = std::stoul(match[1]);
+                if (match[2].matched) {
+                    std::string fraction = match[3];
+                    fraction.resize(3, '0');
+                    unsigned long seconds = std::stoul(match[2]);
+                    if (seconds > 86400)
+                        throw po::error("bad rate-limit '" + value + "', interval must be at most 86400 seconds");
+                    options.rate_limit_interval = std::chrono::milliseconds(seconds * 1000 + std::stoul(fraction));
+                }
+                if (options.rate_limit_interval.count() <= 0)
+                    throw po::error("bad rate-limit '" + value + "', interval must be positive");
+            } else if (key == "reorder") {
+                static const boost::regex r("\\d{1,5}");
+                if (!boost::regex_match(value, r) || std::stoul(value) == 0)
+                    throw po::error("bad reorder '" + value + "', expected a hold time in milliseconds");
+                options.reorder_hold = std::chrono::milliseconds(std::stoul(value));
+            } else if (key == "queue-limit") {
+                static const boost::regex r("\\d{1,10}");
+                if (!boost::regex_match(value, r) || std::stoull(value) == 0)
+                    throw po::error("bad queue-limit '" + value + "', expected a size in bytes");
+                options.queue_limit = std::stoull(value);
+            } else if (key == "sndbuf") {
+                static const boost::regex r("\\d{1,9}");
+                if (!boost::regex_match(value, r) || std::stoul(value) == 0)
+                    throw po::error("bad sndbuf '" + value + "', expected a size in bytes");
+                options.send_buffer_size = std::stoul(value);
+            } else if (key == "nodelay" && eq == std::string::npos) {
+                options.no_delay = true;
+            } else if (key == "thread" && !value.empty()) {
+                o.thread = value;
+            } else if (key == "format") {
+                if (value == "beast")
+                    options.format = beast::OutputFormat::BEAST;
+                else if (value == "json")
+                    options.format = beast::OutputFormat::JSON;
+                else if (value == "csv")
+                    options.format = beast::OutputFormat::CSV;
+                else if (value == "sbs")
+                    options.format = beast::OutputFormat::SBS;
+                else
+                    throw po::error("bad format '" + value + "', expected beast, json, csv or sbs");
+            } else {
+                throw po::error("unrecognized output option '" + item + "'");
+            }
+        } catch (const std::runtime_error &err) {
+            throw po::error(err.what());
+        }
+
+        start = end;
+    }
+}
+
 // Specializations of validate for --listen / --connect / --net
 void validate(boost::any& v,
               const std::vector<std::string>& values,
@@ -75,44 +233,102 @@ void validate(boost::any& v,
     }
 }
 
+static connect_option parse_connect_option(const std::string &s)
+{
+    static const boost::regex r("([^:]+):(\\d+)(?::([a-zA-Z]+))?((?::[a-z][a-z0-9-]*(?:=[^:]*)?)*)");
+    boost::smatch match;
+    if (!boost::regex_match(s, match, r))
+        throw po::validation_error(po::validation_error::invalid_option_value);
+
+    connect_option o;
+    o.spec = s;
+    o.host = match[1];
+    o.port = match[2];
+    o.settings = beast::Settings(match[3]);
+    parse_output_options(match[4], o);
+    return o;
+}
+
+static listen_option parse_listen_option(const std::string &s)
+{
+    static const boost::regex r("(?:([^:]+):)?(\\d+)(?::([a-zA-Z]+))?((?::[a-z][a-z0-9-]*(?:=[^:]*)?)*)");
+    boost::smatch match;
+    if (!boost::regex_match(s, match, r))
+        throw po::validation_error(po::validation_error::invalid_option_value);
+
+    listen_option o;
+    o.spec = s;
+    o.host = match[1];
+    o.port = match[2];
+    o.settings = beast::Settings(match[3]);
+    parse_output_options(match[4], o);
+    return o;
+}
+
+static beast::Settings parse_force_settings(const std::string &s)
+{
+    static const boost::regex r("[cdefghijbrCDEFGHIJBR]*");
+    if (!boost::regex_match(s, r))
+        throw po::validation_error(po::validation_error::invalid_option_value);
+    return beast::Settings(s);
+}
+
+// NAME[:cpu=N][:realtime-priority=N][:nice=N]
 void validate(boost::any& v,
               const std::vector<std::string>& values,
-              connect_option* target_type, int)
+              output_thread_option* target_type, int)
 {
     po::validators::check_first_occurrence(v);
     const std::string &s = po::validators::get_single_string(values);
 
-    static const boost::regex r("([^:]+):(\\d+)(?::([a-zA-Z]+))?");
+    static const boost::regex r("([a-zA-Z0-9_-]+)((?::[a-z-]+=-?\\d{1,3})*)");
+    static const boost::regex item("([a-z-]+)=(-?\\d{1,3})");
     boost::smatch match;
-    if (boost::regex_match(s, match, r)) {
-        connect_option o;
-        o.host = match[1];
-        o.port = match[2];
-        o.settings = beast::Settings(match[3]);
-        v = boost::any(o);
-    } else {
+    if (!boost::regex_match(s, match, r))
         throw po::validation_error(po::validation_error::invalid_option_value);
+
+    output_thread_option o;
+    o.name = match[1];
+
+    const std::string rest = match[2];
+    for (boost::sregex_iterator i(rest.begin(), rest.end(), item), end; i != end; ++i) {
+        const std::string key = (*i)[1];
+        const int value = std::stoi((*i)[2]);
+        if (key == "cpu") {
+            if (value < 0 || value >= CPU_SETSIZE)
+                throw po::error("bad output thread cpu '" + std::to_string(value) + "', expected a CPU number");
+            o.scheduling.cpu = value;
+        } else if (key == "realtime-priority") {
+            if (value < 1 || value > 99)
+                throw po::error("bad output thread realtime-priority '" + std::to_string(value) + "', expected 1-99");
+            o.scheduling.realtime_priority = value;
+        } else if (key == "nice") {
+            if (value < -20 || value > 19)
+                throw po::error("bad output thread nice '" + std::to_string(value) + "', expected -20 to 19");
+            o.scheduling.nice = value;
+            o.scheduling.set_nice = true;
+        } else {
+            throw po::error("unrecognized output thread option '" + key + "'");
+        }
     }
+
+    v = boost::any(o);
 }
 
 void validate(boost::any& v,
               const std::vector<std::string>& values,
-              listen_option* target_type, int)
+              connect_option* target_type, int)
 {
     po::validators::check_first_occurrence(v);
-    const std::string &s = po::validators::get_single_string(values);
+    v = boost::any(parse_connect_option(po::validators::get_single_string(values)));
+}
 
-    static const boost::regex r("(?:([^:]+):)?(\\d+)(?::([a-zA-Z]+))?");
-    boost::smatch match;
-    if (boost::regex_match(s, match, r)) {
-        listen_option o;
-        o.host = match[1];
-        o.port = match[2];
-        o.settings = beast::Settings(match[3]);
-        v = boost::any(o);
-    } else {
-        throw po::validation_error(po::validation_error::invalid_option_value);
-    }
+void validate(boost::any& v,
+              const std::vector<std::string>& values,
+              listen_option* target_type, int)
+{
+    po::validators::check_first_occurrence(v);
+    v = boost::any(parse_listen_option(po::validators::get_single_string(values)));
 }
 
 namespace beast {
@@ -121,15 +337,639 @@ namespace beast {
                   beast::Settings* target_type, long int)
     {
         po::validators::check_first_occurrence(v);
-        const std::string &s = po::validators::get_single_string(values);
+        v = boost::any(parse_force_settings(po::validators::get_single_string(values)));
+    }
+}
+
+// The parts of the splitter that can be changed while it is running:
+// listeners, connectors, the forced input settings and the status file.
+// Changes never touch outputs that are already connected; removing a
+// listener only stops it accepting new clients.
+class RuntimeConfig {
+public:
+    typedef std::map<std::string, std::unique_ptr<splitter::OutputThread>> thread_map;
+
+    RuntimeConfig(boost::asio::io_service &service_,
+                  modes::FilterDistributor &distributor_,
+                  beast::BeastInput::pointer input_,
+                  helpers::WorkPool *encode_pool_,
+                  const thread_map &output_threads_,
+                  std::shared_ptr<const splitter::SchedulingStatus> scheduling_)
+        : service(service_),
+          distributor(distributor_),
+          input(input_),
+          encode_pool(encode_pool_),
+          output_threads(output_threads_),
+          scheduling(scheduling_),
+          resolver(service_),
+          sbs_encoder(std::make_shared<sbs::Encoder>()),
+          handoff_timer(service_),
+          handing_off(false)
+    {
+    }
+
+    // how long to wait for outputs to write out what they hold before
+    // handing off; clients that are still busy after this are dropped
+    const std::chrono::milliseconds handoff_drain_timeout = std::chrono::milliseconds(2000);
+
+    // these throw std::runtime_error if the change can't be made
+    void add_listener(listen_option l);
+    void remove_listener(const listen_option &l);
+    void remove_listener(const std::string &key);
+    void add_connector(connect_option c);
+    void remove_connector(const connect_option &c);
+    void remove_connector(const std::string &key);
+    void set_force(const beast::Settings &settings);
+    void open_status_file(const std::string &path);
+    void reopen_status_file();
+    bool has_status_file() const { return !status_path.empty(); }
+
+    // Bring the listeners, connectors, forced settings and status file in
+    // line with a reloaded configuration, leaving alone anything that
+    // hasn't changed. Problems are logged and skipped.
+    void reconfigure(const std::vector<listen_option> &new_listeners,
+                     const std::vector<connect_option> &new_connectors,
+                     const beast::Settings &force,
+                     const std::string &new_status_path);
+
+    // called for the "reload" control command
+    void set_reload_handler(std::function<void()> handler) {
+        reload_handler = handler;
+    }
+
+    // handler for --control commands
+    std::string handle_command(const std::string &line);
+
+    // Taking over from a previous process: inherit() must be called before
+    // any listeners or connectors are added, which then use inherited
+    // sockets where they match. start_input() adopts the inherited input
+    // connection if there is one, and closes anything left unclaimed.
+    void inherit(std::vector<splitter::HandoffItem> items);
+    void start_input();
+
+    // Hand everything over to a new process connected on sock, then call
+    // done with whether it worked. If it didn't, this process has already
+    // resumed reading from the receiver and carries on serving.
+    void hand_off(int sock, std::function<void(bool)> done);
+
+private:
+    int take_inherited(const std::string &prefix, std::string &rest);
+    int take_inherited_listener(const tcp::endpoint &endpoint);
+    void drain_for_handoff(int sock, std::chrono::steady_clock::time_point deadline, std::function<void(bool)> done);
+    bool send_handoff(int sock);
+    splitter::OutputThread *find_thread(const std::string &name) const;
+
+    // Run f on the thread that owns an output's sockets: right away for
+    // the main thread, otherwise posted to the output thread.
+    static void run_on(splitter::OutputThread *thread, std::function<void()> f) {
+        if (thread)
+            thread->service().post(f);
+        else
+            f();
+    }
+
+    static std::string listen_key(const listen_option &l) {
+        return l.host.empty() ? l.port : l.host + ":" + l.port;
+    }
+
+    static std::string connect_key(const connect_option &c) {
+        return c.host + ":" + c.port;
+    }
+
+    boost::asio::io_service &service;
+    modes::FilterDistributor &distributor;
+    beast::BeastInput::pointer input;
+    helpers::WorkPool *encode_pool;
+    const thread_map &output_threads;
+    std::shared_ptr<const splitter::SchedulingStatus> scheduling;
+    tcp::resolver resolver;
+
+    // all SBS outputs share one encoder, so each message is rendered once
+    std::shared_ptr<sbs::Encoder> sbs_encoder;
+
+    std::map<std::string, std::vector<beast::SocketListener::pointer>> listeners;
+    std::map<std::string, beast::SocketConnector::pointer> connectors;
+
+    // the specification each listener and connector was created from
+    std::map<std::string, std::string> listen_specs;
+    std::map<std::string, std::string> connect_specs;
+
+    // listeners and connectors running on an output thread
+    std::map<std::string, splitter::OutputThread*> listen_threads;
+    std::map<std::string, splitter::OutputThread*> connect_threads;
+
+    std::function<void()> reload_handler;
+
+    // the distributor can't drop monitors, so these outlive any one
+    // status writer and keep their history across a reopen
+    std::string status_path;
+    splitter::StatusWriter::pointer status_writer;
+    std::shared_ptr<modes::AircraftTable> aircraft;
+    std::shared_ptr<modes::SignalStats> signal;
+    std::shared_ptr<modes::ClockMonitor> clock;
+
+    // sockets inherited from a previous process and not yet claimed
+    std::vector<splitter::HandoffItem> inherited;
+
+    boost::asio::steady_timer handoff_timer;
+    bool handing_off;
+};
+
+void RuntimeConfig::add_listener(listen_option l)
+{
+    const std::string key = listen_key(l);
+    if (listeners.count(key))
+        throw std::runtime_error("already listening on " + key);
+
+    splitter::OutputThread *thread = find_thread(l.thread);
+    boost::asio::io_service &output_service = (thread ? thread->service() : service);
+    modes::FilterDistributor &output_distributor = (thread ? thread->distributor() : distributor);
+
+    if (l.options.format == beast::OutputFormat::SBS)
+        l.options.sbs_encoder = sbs_encoder;
+    l.options.encode_pool = encode_pool;
+
+    tcp::resolver::query query(l.host, l.port, tcp::resolver::query::passive);
+    boost::system::error_code ec;
+
+    std::vector<beast::SocketListener::pointer> started;
+    tcp::resolver::iterator end;
+    for (auto i = resolver.resolve(query, ec); i != end; ++i) {
+        const auto &endpoint = i->endpoint();
+
+        try {
+            // Binding happens here so that errors can be reported; the
+            // output thread only sees the listener once it is accepting.
+            auto listener = beast::SocketListener::create(output_service, endpoint, output_distributor, l.settings, l.options);
+            int fd = take_inherited_listener(endpoint);
+            if (fd >= 0) {
+                listener->start(fd);
+                std::cerr << "Took over listening on " << endpoint << std::endl;
+            } else {
+                listener->start();
+                std::cerr << "Listening on " << endpoint << std::endl;
+            }
+            started.push_back(listener);
+        } catch (boost::system::system_error &err) {
+            std::cerr << "Could not listen on " << endpoint << ": " << err.what() << std::endl;
+            ec = err.code();
+        }
+    }
+
+    if (started.empty()) {
+        if (l.host.empty())
+            throw std::runtime_error("Could not bind to port " + l.port + ": " + ec.message());
+        else
+            throw std::runtime_error("Could not bind to " + l.host + ":" + l.port + ": " + ec.message());
+    }
+
+    std::string settings;
+    for (int fd; (fd = take_inherited("client listen " + key, settings)) >= 0; ) {
+        auto listener = started.front();
+        beast::Settings adopted(settings);
+        run_on(thread, [listener,fd,adopted] { listener->adopt(fd, adopted); });
+    }
+
+    listeners[key] = std::move(started);
+    listen_specs[key] = l.spec;
+    if (thread) {
+        listen_threads[key] = thread;
+        std::cerr << "Listeners on " << key << " run on output thread " << thread->name() << std::endl;
+    }
+}
+
+void RuntimeConfig::remove_listener(const listen_option &l)
+{
+    remove_listener(listen_key(l));
+}
+
+void RuntimeConfig::remove_listener(const std::string &key)
+{
+    auto i = listeners.find(key);
+    if (i == listeners.end())
+        throw std::runtime_error("not listening on " + key);
+
+    auto t = listen_threads.find(i->first);
+    splitter::OutputThread *thread = (t == listen_threads.end() ? nullptr : t->second);
+    for (auto &listener : i->second)
+        run_on(thread, [listener] { listener->close(); });
+    std::cerr << "Stopped listening on " << i->first << std::endl;
+    listen_specs.erase(i->first);
+    listen_threads.erase(i->first);
+    listeners.erase(i);
+}
+
+void RuntimeConfig::add_connector(connect_option c)
+{
+    const std::string key = connect_key(c);
+    if (connectors.count(key))
+        throw std::runtime_error("already connecting to " + key);
+
+    splitter::OutputThread *thread = find_thread(c.thread);
+
+    if (c.options.format == beast::OutputFormat::SBS)
+        c.options.sbs_encoder = sbs_encoder;
+    c.options.encode_pool = encode_pool;
+
+    auto connector = beast::SocketConnector::create(thread ? thread->service() : service,
+                                                    c.host, c.port,
+                                                    thread ? thread->distributor() : distributor,
+                                                    c.settings, c.options);
+    std::string settings;
+    int fd = take_inherited("client connect " + key, settings);
+    if (fd >= 0) {
+        beast::Settings adopted(settings);
+        run_on(thread, [connector,fd,adopted] { connector->adopt(fd, adopted); });
+    } else {
+        run_on(thread, [connector] { connector->start(); });
+    }
+    connectors[key] = connector;
+    connect_specs[key] = c.spec;
+    if (thread) {
+        connect_threads[key] = thread;
+        std::cerr << "Connection to " << key << " runs on output thread " << thread->name() << std::endl;
+    }
+}
+
+void RuntimeConfig::remove_connector(const connect_option &c)
+{
+    remove_connector(connect_key(c));
+}
+
+void RuntimeConfig::remove_connector(const std::string &key)
+{
+    auto i = connectors.find(key);
+    if (i == connectors.end())
+        throw std::runtime_error("not connecting to " + key);
+
+    auto t = connect_threads.find(i->first);
+    auto connector = i->second;
+    run_on(t == connect_threads.end() ? nullptr : t->second, [connector] { connector->close(); });
+    std::cerr << "Stopped connecting to " << i->first << std::endl;
+    connect_specs.erase(i->first);
+    connect_threads.erase(i->first);
+    connectors.erase(i);
+}
+
+splitter::OutputThread *RuntimeConfig::find_thread(const std::string &name) const
+{
+    if (name.empty())
+        return nullptr;
+
+    auto i = output_threads.find(name);
+    if (i == output_threads.end())
+        throw std::runtime_error("no --output-thread named " + name);
+    return i->second.get();
+}
 
-        static const boost::regex r("[cdefghijbrCDEFGHIJBR]*");
-        if (boost::regex_match(s, r)) {
-            v = boost::any(beast::Settings(s));
+void RuntimeConfig::set_force(const beast::Settings &settings)
+{
+    std::cerr << "Forcing settings " << settings << std::endl;
+    input->set_fixed_settings(settings);
+}
+
+void RuntimeConfig::open_status_file(const std::string &path)
+{
+    if (!aircraft) {
+        aircraft = std::make_shared<modes::AircraftTable>();
+        distributor.add_monitor(std::bind(&modes::AircraftTable::update, aircraft, std::placeholders::_1));
+
+        signal = std::make_shared<modes::SignalStats>();
+        distributor.add_monitor(std::bind(&modes::SignalStats::update, signal, std::placeholders::_1));
+
+        clock = std::make_shared<modes::ClockMonitor>();
+        distributor.add_monitor(std::bind(&modes::ClockMonitor::update, clock, std::placeholders::_1));
+    }
+
+    if (status_writer)
+        status_writer->close();
+
+    status_path = path;
+    status_writer = splitter::StatusWriter::create(service, distributor, input, status_path, aircraft, signal, clock, scheduling);
+    status_writer->start();
+}
+
+void RuntimeConfig::reopen_status_file()
+{
+    if (status_path.empty())
+        throw std::runtime_error("no status file configured");
+
+    std::cerr << "Reopening status file " << status_path << std::endl;
+    open_status_file(status_path);
+}
+
+void RuntimeConfig::reconfigure(const std::vector<listen_option> &new_listeners,
+                                const std::vector<connect_option> &new_connectors,
+                                const beast::Settings &force,
+                                const std::string &new_status_path)
+{
+    // Anything whose specification changed is replaced. Clients already
+    // connected to a replaced listener keep their old options.
+    std::map<std::string, const listen_option*> wanted_listeners;
+    for (const auto &l : new_listeners)
+        wanted_listeners[listen_key(l)] = &l;
+
+    std::vector<std::string> stale;
+    for (const auto &l : listen_specs) {
+        auto i = wanted_listeners.find(l.first);
+        if (i == wanted_listeners.end() || i->second->spec != l.second)
+            stale.push_back(l.first);
+    }
+    for (const auto &key : stale)
+        remove_listener(key);
+
+    for (const auto &w : wanted_listeners) {
+        if (listen_specs.count(w.first))
+            continue;
+        try {
+            add_listener(*w.second);
+        } catch (const std::runtime_error &err) {
+            std::cerr << err.what() << std::endl;
+        }
+    }
+
+    std::map<std::string, const connect_option*> wanted_connectors;
+    for (const auto &c : new_connectors)
+        wanted_connectors[connect_key(c)] = &c;
+
+    stale.clear();
+    for (const auto &c : connect_specs) {
+        auto i = wanted_connectors.find(c.first);
+        if (i == wanted_connectors.end() || i->second->spec != c.second)
+            stale.push_back(c.first);
+    }
+    for (const auto &key : stale)
+        remove_connector(key);
+
+    for (const auto &w : wanted_connectors) {
+        if (connect_specs.count(w.first))
+            continue;
+        try {
+            add_connector(*w.second);
+        } catch (const std::runtime_error &err) {
+            std::cerr << err.what() << std::endl;
+        }
+    }
+
+    std::ostringstream old_force, new_force;
+    old_force << input->get_fixed_settings();
+    new_force << force;
+    if (old_force.str() != new_force.str())
+        set_force(force);
+
+    if (!new_status_path.empty() && new_status_path != status_path)
+        open_status_file(new_status_path);
+    else if (has_status_file())
+        reopen_status_file();
+}
+
+void RuntimeConfig::inherit(std::vector<splitter::HandoffItem> items)
+{
+    inherited = std::move(items);
+}
+
+// Find and remove the inherited item described by prefix, optionally
+// followed by a space and more text, which is returned in rest.
+int RuntimeConfig::take_inherited(const std::string &prefix, std::string &rest)
+{
+    for (auto i = inherited.begin(); i != inherited.end(); ++i) {
+        const std::string &d = i->description;
+        if (d.compare(0, prefix.size(), prefix) != 0 || i->fd < 0)
+            continue;
+        if (d.size() > prefix.size() && d[prefix.size()] != ' ')
+            continue;
+
+        rest = (d.size() > prefix.size() ? d.substr(prefix.size() + 1) : std::string());
+        int fd = i->fd;
+        inherited.erase(i);
+        return fd;
+    }
+
+    return -1;
+}
+
+int RuntimeConfig::take_inherited_listener(const tcp::endpoint &endpoint)
+{
+    for (auto i = inherited.begin(); i != inherited.end(); ++i) {
+        if (i->description.compare(0, 9, "listener ") != 0 || i->fd < 0)
+            continue;
+
+        tcp::endpoint bound;
+        socklen_t len = bound.capacity();
+        if (::getsockname(i->fd, bound.data(), &len) < 0)
+            continue;
+        bound.resize(len);
+
+        if (bound == endpoint) {
+            int fd = i->fd;
+            inherited.erase(i);
+            return fd;
+        }
+    }
+
+    return -1;
+}
+
+void RuntimeConfig::start_input()
+{
+    std::string state;
+    int fd = take_inherited("input", state);
+    if (fd >= 0 && !input->adopt(fd, state)) {
+        std::cerr << "Not taking over the previous process's input, it was configured differently" << std::endl;
+        ::close(fd);
+        fd = -1;
+    }
+
+    if (fd < 0)
+        input->start();
+
+    for (const auto &item : inherited) {
+        if (item.fd >= 0) {
+            std::cerr << "Closing inherited " << item.description << ", it is no longer configured" << std::endl;
+            ::close(item.fd);
+        }
+    }
+    inherited.clear();
+}
+
+void RuntimeConfig::hand_off(int sock, std::function<void(bool)> done)
+{
+    if (handing_off) {
+        ::close(sock);
+        return;
+    }
+
+    std::cerr << "Handing off to a new process" << std::endl;
+    handing_off = true;
+
+    // nothing more is read from the receiver; it waits in the kernel
+    // for the new process
+    input->suspend();
+    drain_for_handoff(sock, std::chrono::steady_clock::now() + handoff_drain_timeout, done);
+}
+
+void RuntimeConfig::drain_for_handoff(int sock, std::chrono::steady_clock::time_point deadline, std::function<void(bool)> done)
+{
+    bool all_drained = true;
+    auto check = [&all_drained] (const beast::SocketOutput::pointer &output) {
+        output->drain();
+        if (!output->drained())
+            all_drained = false;
+    };
+
+    // outputs on output threads can't be inspected from here; they are
+    // dropped rather than handed off, and their clients reconnect
+    for (const auto &l : listeners) {
+        if (listen_threads.count(l.first))
+            continue;
+        for (const auto &listener : l.second) {
+            for (const auto &output : listener->connected_outputs())
+                check(output);
+        }
+    }
+    for (const auto &c : connectors) {
+        if (connect_threads.count(c.first))
+            continue;
+        if (auto output = c.second->connected_output())
+            check(output);
+    }
+
+    if (all_drained || std::chrono::steady_clock::now() >= deadline) {
+        bool ok = send_handoff(sock);
+        ::close(sock);
+        if (!ok) {
+            // the new process discards a partial handoff, so nothing it
+            // was sent is in use; carry on as before
+            std::cerr << "Carrying on after failed handoff" << std::endl;
+            handing_off = false;
+            input->resume();
+        }
+        done(ok);
+        return;
+    }
+
+    handoff_timer.expires_from_now(std::chrono::milliseconds(10));
+    handoff_timer.async_wait([this,sock,deadline,done] (const boost::system::error_code &ec) {
+            drain_for_handoff(sock, deadline, done);
+        });
+}
+
+bool RuntimeConfig::send_handoff(int sock)
+{
+    unsigned handed = 0, dropped = 0;
+
+    auto send_client = [&] (const std::string &what, const beast::SocketOutput::pointer &output) {
+        if (!output->drained()) {
+            // part of a message may already be on the wire
+            ++dropped;
+            return;
+        }
+
+        std::ostringstream description;
+        description << "client " << what << " " << output->current_settings();
+        splitter::send_handoff_item(sock, { description.str(), output->native_handle() });
+        ++handed;
+    };
+
+    try {
+        if (input->is_connected() && input->native_handle() >= 0)
+            splitter::send_handoff_item(sock, { "input " + input->handoff_state(), input->native_handle() });
+
+        for (const auto &l : listeners) {
+            for (const auto &listener : l.second)
+                splitter::send_handoff_item(sock, { "listener " + l.first, listener->native_handle() });
+        }
+
+        for (const auto &l : listeners) {
+            if (listen_threads.count(l.first))
+                continue;
+            for (const auto &listener : l.second) {
+                for (const auto &output : listener->connected_outputs())
+                    send_client("listen " + l.first, output);
+            }
+        }
+
+        for (const auto &c : connectors) {
+            if (connect_threads.count(c.first))
+                continue;
+            if (auto output = c.second->connected_output())
+                send_client("connect " + c.first, output);
+        }
+
+        splitter::send_handoff_item(sock, { "end", -1 });
+    } catch (const boost::system::system_error &err) {
+        std::cerr << "Handoff failed: " << err.what() << std::endl;
+        return false;
+    }
+
+    std::cerr << "Handed off " << handed << " clients";
+    if (dropped)
+        std::cerr << ", dropped " << dropped << " that were still busy";
+    std::cerr << std::endl;
+    return true;
+}
+
+std::string RuntimeConfig::handle_command(const std::string &line)
+{
+    std::string command = line, arg;
+    std::size_t space = line.find(' ');
+    if (space != std::string::npos) {
+        command = line.substr(0, space);
+        std::size_t start = line.find_first_not_of(' ', space);
+        if (start != std::string::npos)
+            arg = line.substr(start);
+    }
+
+    try {
+        if (command == "listen") {
+            add_listener(parse_listen_option(arg));
+        } else if (command == "unlisten") {
+            remove_listener(parse_listen_option(arg));
+        } else if (command == "connect") {
+            add_connector(parse_connect_option(arg));
+        } else if (command == "disconnect") {
+            remove_connector(parse_connect_option(arg));
+        } else if (command == "force") {
+            set_force(parse_force_settings(arg));
+        } else if (command == "status-file") {
+            if (arg.empty())
+                reopen_status_file();
+            else
+                open_status_file(arg);
+        } else if (command == "reload") {
+            if (!reload_handler)
+                throw std::runtime_error("no --config file to reload");
+            reload_handler();
+        } else if (command == "list") {
+            std::ostringstream os;
+            for (const auto &l : listen_specs)
+                os << "listen " << l.second << "\n";
+            for (const auto &c : connect_specs)
+                os << "connect " << c.second << "\n";
+            os << "force " << input->get_fixed_settings() << "\n";
+            if (!status_path.empty())
+                os << "status-file " << status_path << "\n";
+            return os.str();
         } else {
-            throw po::validation_error(po::validation_error::invalid_option_value);
+            throw std::runtime_error("unknown command '" + command + "', expected listen, unlisten, connect, disconnect, force, status-file, reload or list");
         }
+    } catch (const po::validation_error &err) {
+        throw std::runtime_error("bad " + command + " argument '" + arg + "'");
+    } catch (const po::error &err) {
+        throw std::runtime_error("bad " + command + " argument '" + arg + "': " + err.what());
     }
+
+    return std::string();
+}
+
+// Parse the command line, then the --config file if one was given.
+// Options on the command line take precedence over those in the file.
+static void parse_options(const po::options_description &desc, int argc, char **argv, po::variables_map &opts)
+{
+    po::store(po::parse_command_line(argc, argv, desc), opts);
+    if (opts.count("config"))
+        po::store(po::parse_config_file<char>(opts["config"].as<std::string>().c_str(), desc), opts);
+    po::notify(opts);
 }
 
 #define EXIT_NO_RESTART (64)
@@ -137,24 +977,46 @@ namespace beast {
 static int realmain(int argc, char **argv)
 {
     boost::asio::io_service io_service;
+#ifdef BOOST_ASIO_HAS_IO_URING
+    // asio chooses its backend at compile time, so there is no epoll to
+    // fall back to if the kernel refuses to set up a ring. The ring is
+    // normally created on first use; create it now, so that this failure
+    // is told apart from everything else.
+    try {
+        boost::asio::use_service<boost::asio::detail::io_uring_service>(io_service);
+    } catch (const boost::system::system_error &e) {
+        std::cerr << "io_uring is not available (" << e.what() << "); use a build without IO_URING=1" << std::endl;
+        return EXIT_NO_RESTART;
+    }
+#endif
     modes::FilterDistributor distributor;
 
     po::options_description desc("Allowed options");
     desc.add_options()
         ("help", "produce help message")
+        ("config", po::value<std::string>(), "read further options from this file, and reread it on SIGHUP")
         ("serial", po::value<std::string>(), "read from given serial device")
         ("net", po::value<net_option>(), "read from given network host:port")
         ("status-file", po::value<std::string>(), "set path to status file")
         ("fixed-baud", po::value<unsigned>()->default_value(0), "set a fixed baud rate, or 0 for autobauding")
-        ("listen", po::value< std::vector<listen_option> >(), "specify a [host:]port[:settings] to listen on")
-        ("connect", po::value< std::vector<connect_option> >(), "specify a host:port[:settings] to connect to")
-        ("force", po::value<beast::Settings>()->default_value(beast::Settings()), "specify settings to force on or off when configuring the Beast");
+        ("listen", po::value< std::vector<listen_option> >(), "specify a [host:]port[:settings][:option=value...] to listen on")
+        ("connect", po::value< std::vector<connect_option> >(), "specify a host:port[:settings][:option=value...] to connect to")
+        ("force", po::value<beast::Settings>()->default_value(beast::Settings()), "specify settings to force on or off when configuring the Beast")
+        ("control", po::value<std::string>(), "accept reconfiguration commands on this Unix socket path")
+        ("state-file", po::value<std::string>(), "remember the detected receiver type and baud rate in this file, to start faster next time")
+        ("handoff", po::value<std::string>(), "take over connections from a previous process via this Unix socket path, and hand them to the next")
+        ("cpu", po::value<int>(), "pin the receive thread to this CPU")
+        ("realtime-priority", po::value<int>(), "run the receive thread with SCHED_FIFO at this priority (1-99)")
+        ("nice", po::value<int>(), "set the nice value of the receive thread (-20 to 19)")
+        ("mlock", "lock all memory with mlockall")
+        ("output-thread", po::value< std::vector<output_thread_option> >(), "start an output thread NAME[:cpu=N][:realtime-priority=N][:nice=N] for outputs given :thread=NAME")
+        ("simd", po::value<std::string>(), "use this instruction set for the hot loops (scalar, sse2, avx2, avx512 or neon) instead of the best available")
+        ("encode-threads", po::value<unsigned>()->default_value(0), "encode json, csv and sbs output on this many threads (0: encode inline)");
 
     po::variables_map opts;
 
     try {
-        po::store(po::parse_command_line(argc, argv, desc), opts);
-        po::notify(opts);
+        parse_options(desc, argc, argv, opts);
     } catch (boost::program_options::error &err) {
         std::cerr << err.what() << std::endl;
         std::cerr << desc << std::endl;
@@ -166,12 +1028,85 @@ static int realmain(int argc, char **argv)
         return EXIT_NO_RESTART;
     }
 
-    if (!opts.count("connect") && !opts.count("listen")) {
-        std::cerr << "At least one --connect or --listen argument is needed" << std::endl;
+    if (!opts.count("connect") && !opts.count("listen") && !opts.count("control")) {
+        std::cerr << "At least one --connect, --listen or --control argument is needed" << std::endl;
         std::cerr << desc << std::endl;
         return EXIT_NO_RESTART;
     }
 
+    // pick the kernels before any other thread can use them
+    helpers::SimdLevel simd = helpers::detect_simd_level();
+    if (opts.count("simd")) {
+        if (!helpers::parse_simd_level(opts["simd"].as<std::string>(), simd)) {
+            std::cerr << "--simd must be one of scalar, sse2, avx2, avx512 or neon" << std::endl;
+            return EXIT_NO_RESTART;
+        }
+    }
+    try {
+        helpers::select_kernels(simd);
+    } catch (const std::runtime_error &err) {
+        std::cerr << "--simd " << helpers::simd_level_name(simd) << ": " << err.what() << std::endl;
+        return EXIT_NO_RESTART;
+    }
+    std::cerr << "Using " << helpers::simd_level_name(simd) << " kernels"
+              << (opts.count("simd") ? " (forced)" : "") << std::endl;
+
+    splitter::SchedulingOptions scheduling_options;
+    if (opts.count("cpu")) {
+        scheduling_options.cpu = opts["cpu"].as<int>();
+        if (scheduling_options.cpu < 0 || scheduling_options.cpu >= CPU_SETSIZE) {
+            std::cerr << "--cpu must be a CPU number" << std::endl;
+            return EXIT_NO_RESTART;
+        }
+    }
+    if (opts.count("realtime-priority")) {
+        scheduling_options.realtime_priority = opts["realtime-priority"].as<int>();
+        if (scheduling_options.realtime_priority < 1 || scheduling_options.realtime_priority > 99) {
+            std::cerr << "--realtime-priority must be in the range 1-99" << std::endl;
+            return EXIT_NO_RESTART;
+        }
+    }
+    if (opts.count("nice")) {
+        scheduling_options.nice = opts["nice"].as<int>();
+        scheduling_options.set_nice = true;
+        if (scheduling_options.nice < -20 || scheduling_options.nice > 19) {
+            std::cerr << "--nice must be in the range -20 to 19" << std::endl;
+            return EXIT_NO_RESTART;
+        }
+    }
+    scheduling_options.lock_memory = (opts.count("mlock") > 0);
+
+    // Start encoder threads before applying the scheduling options, so
+    // they don't inherit the receive thread's CPU and priority.
+    // The pool is declared after io_service, so its threads are stopped
+    // before any handlers they might post to are destroyed.
+    //
+    // Output threads likewise start first and pick their own scheduling.
+    // They are declared before the pool because encoded output is posted
+    // to their io_services.
+    RuntimeConfig::thread_map output_threads;
+    if (opts.count("output-thread")) {
+        for (const auto &t : opts["output-thread"].as< std::vector<output_thread_option> >()) {
+            if (output_threads.count(t.name)) {
+                std::cerr << "--output-thread " << t.name << " is given more than once" << std::endl;
+                return EXIT_NO_RESTART;
+            }
+            output_threads[t.name].reset(new splitter::OutputThread(io_service, distributor, t.name, t.scheduling));
+        }
+    }
+
+    std::unique_ptr<helpers::WorkPool> encode_pool;
+    if (opts["encode-threads"].as<unsigned>() > 0)
+        encode_pool.reset(new helpers::WorkPool(opts["encode-threads"].as<unsigned>()));
+
+    std::shared_ptr<splitter::SchedulingStatus> scheduling;
+    if (scheduling_options.any()) {
+        scheduling = std::make_shared<splitter::SchedulingStatus>(splitter::apply_scheduling(scheduling_options));
+        for (const auto &e : scheduling->errors)
+            std::cerr << "Warning: " << e << std::endl;
+        std::cerr << "Scheduling: " << *scheduling << std::endl;
+    }
+
     beast::BeastInput::pointer input;
     if (opts.count("serial")) {
         input = beast::SerialInput::create(io_service,
@@ -192,53 +1127,143 @@ static int realmain(int argc, char **argv)
 
     distributor.set_filter_notifier(std::bind(&beast::BeastInput::set_filter, input, std::placeholders::_1));
 
-    tcp::resolver resolver(io_service);
+    std::shared_ptr<splitter::StateFile> state_file;
+    if (opts.count("state-file")) {
+        state_file = std::make_shared<splitter::StateFile>(opts["state-file"].as<std::string>());
 
-    if (opts.count("listen")) {
-        for (auto l : opts["listen"].as< std::vector<listen_option> >()) {
-            tcp::resolver::query query(l.host, l.port, tcp::resolver::query::passive);
-            boost::system::error_code ec;
-
-            bool success = false;
-            tcp::resolver::iterator end;
-            for (auto i = resolver.resolve(query, ec); i != end; ++i) {
-                const auto &endpoint = i->endpoint();
-
-                try {
-                    auto listener = beast::SocketListener::create(io_service, endpoint, distributor, l.settings);
-                    listener->start();
-                    std::cerr << "Listening on " << endpoint << std::endl;
-                    success = true;
-                } catch (boost::system::system_error &err) {
-                    std::cerr << "Could not listen on " << endpoint << ": " << err.what() << std::endl;
-                    ec = err.code();
-                }
+        std::string saved = state_file->get(input->state_key());
+        if (!saved.empty()) {
+            std::cerr << input->state_key() << ": starting from remembered state " << saved << std::endl;
+            input->restore_state(saved);
+        }
+
+        beast::BeastInput *in = input.get();
+        input->set_state_notifier([state_file,in] {
+                state_file->set(in->state_key(), in->learned_state());
+            });
+    }
+
+    RuntimeConfig config(io_service, distributor, input, encode_pool.get(), output_threads, scheduling);
+
+    if (opts.count("handoff")) {
+        try {
+            auto items = splitter::receive_handoff(opts["handoff"].as<std::string>());
+            if (!items.empty()) {
+                std::cerr << "Taking over from the previous process" << std::endl;
+                config.inherit(std::move(items));
             }
+        } catch (const boost::system::system_error &err) {
+            std::cerr << "Could not take over from the previous process, starting afresh: " << err.what() << std::endl;
+        }
+    }
 
-            if (!success) {
-                if (l.host.empty())
-                    std::cerr << "Could not bind to port " << l.port << ": " << ec.message() << std::endl;
-                else
-                    std::cerr << "Could not bind to " << l.host << ":" << l.port << ": " << ec.message() << std::endl;
+    if (opts.count("listen")) {
+        for (const auto &l : opts["listen"].as< std::vector<listen_option> >()) {
+            try {
+                config.add_listener(l);
+            } catch (const std::runtime_error &err) {
+                std::cerr << err.what() << std::endl;
                 return 1;
             }
         }
     }
 
     if (opts.count("connect")) {
-        for (auto l : opts["connect"].as< std::vector<connect_option> >()) {
-            auto connector = beast::SocketConnector::create(io_service, l.host, l.port, distributor, l.settings);
-            connector->start();
+        for (const auto &c : opts["connect"].as< std::vector<connect_option> >()) {
+            try {
+                config.add_connector(c);
+            } catch (const std::runtime_error &err) {
+                std::cerr << err.what() << std::endl;
+                return 1;
+            }
         }
     }
 
-    if (opts.count("status-file")) {
-        auto statuswriter = splitter::StatusWriter::create(io_service, distributor, input, opts["status-file"].as<std::string>());
-        statuswriter->start();
+    if (opts.count("status-file"))
+        config.open_status_file(opts["status-file"].as<std::string>());
+
+    splitter::ControlSocket::pointer control;
+    if (opts.count("control")) {
+        try {
+            control = splitter::ControlSocket::create(io_service, opts["control"].as<std::string>(),
+                                                           std::bind(&RuntimeConfig::handle_command, &config, std::placeholders::_1));
+            control->start();
+        } catch (boost::system::system_error &err) {
+            std::cerr << "Could not open control socket " << opts["control"].as<std::string>() << ": " << err.what() << std::endl;
+            return 1;
+        }
     }
 
+    // Rereading the config file only applies the outputs, --force and
+    // --status-file; everything else needs a restart.
+    std::function<void()> reload = [&] {
+        po::variables_map newopts;
+        try {
+            parse_options(desc, argc, argv, newopts);
+        } catch (boost::program_options::error &err) {
+            throw std::runtime_error("could not reload " + opts["config"].as<std::string>() + ": " + err.what());
+        }
+
+        std::cerr << "Reloading " << opts["config"].as<std::string>() << std::endl;
+        config.reconfigure(newopts.count("listen") ? newopts["listen"].as< std::vector<listen_option> >() : std::vector<listen_option>(),
+                           newopts.count("connect") ? newopts["connect"].as< std::vector<connect_option> >() : std::vector<connect_option>(),
+                           newopts["force"].as<beast::Settings>(),
+                           newopts.count("status-file") ? newopts["status-file"].as<std::string>() : std::string());
+    };
+
+    if (opts.count("config"))
+        config.set_reload_handler(reload);
+
+    // SIGHUP rereads the config file, or failing that reopens the status
+    // file, for setups that expect that of a daemon
+    boost::asio::signal_set hangup(io_service, SIGHUP);
+    std::function<void(const boost::system::error_code &, int)> on_hangup = [&] (const boost::system::error_code &ec, int) {
+        if (ec)
+            return;
+        if (opts.count("config")) {
+            try {
+                reload();
+            } catch (const std::exception &err) {
+                std::cerr << err.what() << std::endl;
+            }
+        } else if (config.has_status_file()) {
+            config.reopen_status_file();
+        }
+        hangup.async_wait(on_hangup);
+    };
+    hangup.async_wait(on_hangup);
+
+    // Exit through the normal path on SIGINT / SIGTERM, so destructors run,
+    // output threads are joined and profiling builds write their data.
+    boost::asio::signal_set terminate(io_service, SIGINT, SIGTERM);
+    terminate.async_wait([&] (const boost::system::error_code &ec, int signal) {
+            if (ec)
+                return;
+            std::cerr << "Exiting on signal " << signal << std::endl;
+            if (control)
+                control->close();
+            io_service.stop();
+        });
+
     input->set_message_notifier(std::bind(&modes::FilterDistributor::broadcast, &distributor, std::placeholders::_1));
-    input->start();
+    config.start_input();
+
+    // once everything has been handed to a new process, this one is done
+    if (opts.count("handoff")) {
+        try {
+            auto handoff = splitter::HandoffServer::create(io_service, opts["handoff"].as<std::string>(),
+                                                           [&] (int sock) {
+                                                               config.hand_off(sock, [&] (bool ok) {
+                                                                       if (ok)
+                                                                           io_service.stop();
+                                                                   });
+                                                           });
+            handoff->start();
+        } catch (boost::system::system_error &err) {
+            std::cerr << "Could not open handoff socket " << opts["handoff"].as<std::string>() << ": " << err.what() << std::endl;
+            return 1;
+        }
+    }
 
     io_service.run();
     return 0;
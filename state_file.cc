@@ -0,0 +1,118 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "state_file.h"
+
+namespace splitter {
+    StateFile::StateFile(const std::string &path_)
+        : path(path_)
+    {
+        load();
+    }
+
+    std::string StateFile::get(const std::string &key) const
+    {
+        auto i = entries.find(key);
+        return (i == entries.end() ? std::string() : i->second);
+    }
+
+    void StateFile::set(const std::string &key, const std::string &value)
+    {
+        auto i = entries.find(key);
+        if (i != entries.end() && i->second == value)
+            return;
+
+        entries[key] = value;
+        save();
+    }
+
+    void StateFile::load()
+    {
+        std::ifstream inf(path);
+        std::string line;
+        while (std::getline(inf, line)) {
+            std::size_t tab = line.find('\t');
+            if (tab == std::string::npos || tab == 0)
+                continue;
+            entries[line.substr(0, tab)] = line.substr(tab + 1);
+        }
+    }
+
+    void StateFile::save()
+    {
+        // write, fsync, then rename, so neither a crash nor a power cut
+        // leaves a partial file
+        std::string contents;
+        for (const auto &e : entries)
+            contents += e.first + '\t' + e.second + '\n';
+
+        std::string temppath = path + ".new";
+        int fd = ::open(temppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << temppath << ": could not write receiver state: " << std::strerror(errno) << std::endl;
+            return;
+        }
+
+        const char *p = contents.data();
+        std::size_t remaining = contents.size();
+        bool ok = true;
+        while (ok && remaining > 0) {
+            ssize_t n = ::write(fd, p, remaining);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                ok = false;
+            else {
+                p += n;
+                remaining -= n;
+            }
+        }
+
+        if (ok && ::fsync(fd) < 0)
+            ok = false;
+        if (!ok)
+            std::cerr << temppath << ": could not write receiver state: " << std::strerror(errno) << std::endl;
+        ::close(fd);
+
+        if (!ok) {
+            ::unlink(temppath.c_str());
+            return;
+        }
+
+        if (std::rename(temppath.c_str(), path.c_str()) < 0) {
+            std::cerr << path << ": could not replace receiver state: " << std::strerror(errno) << std::endl;
+            ::unlink(temppath.c_str());
+        }
+    }
+};
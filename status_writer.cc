@@ -39,11 +39,19 @@ namespace splitter {
     StatusWriter::StatusWriter(asio::io_service &service_,
                                modes::FilterDistributor &distributor_,
                                beast::BeastInput::pointer input_,
-                               const std::string &path_)
+                               const std::string &path_,
+                               std::shared_ptr<modes::AircraftTable> aircraft_,
+                               std::shared_ptr<modes::SignalStats> signal_,
+                               std::shared_ptr<modes::ClockMonitor> clock_,
+                               std::shared_ptr<const SchedulingStatus> scheduling_)
         : service(service_),
           distributor(distributor_),
           input(input_),
           path(path_),
+          aircraft(aircraft_),
+          signal(signal_),
+          clock(clock_),
+          scheduling(scheduling_),
           timeout_timer(service_)
     {
         temppath = path_ + ".new";
@@ -192,6 +200,106 @@ namespace splitter {
                  << "  }," << std::endl;
         }
 
+        if (aircraft) {
+            auto steady_now = std::chrono::steady_clock::now();
+            aircraft->expire(steady_now);
+            auto summary = aircraft->summarize(steady_now);
+
+            outf << "  \"aircraft\" : {" << std::endl
+                 << "    \"current\"       : " << summary.aircraft << "," << std::endl
+                 << "    \"with_position\" : " << summary.with_position << "," << std::endl
+                 << "    \"message_rate\"  : " << summary.message_rate << "," << std::endl
+                 << "    \"signal_mean\"   : " << summary.signal_mean << "," << std::endl
+                 << "    \"df_rate\"       : {";
+            bool first = true;
+            for (std::size_t df = 0; df < summary.df_rate.size(); ++df) {
+                if (summary.df_rate[df] <= 0)
+                    continue;
+                outf << (first ? " " : ", ") << "\"" << df << "\" : " << summary.df_rate[df];
+                first = false;
+            }
+            outf << " }" << std::endl
+                 << "  }," << std::endl;
+        }
+
+        if (signal) {
+            auto summary = signal->summarize();
+
+            outf << "  \"signal\"   : {" << std::endl
+                 << "    \"messages\"         : " << summary.messages << "," << std::endl
+                 << "    \"p10\"              : " << summary.p10 << "," << std::endl
+                 << "    \"median\"           : " << summary.median << "," << std::endl
+                 << "    \"p90\"              : " << summary.p90 << "," << std::endl
+                 << "    \"noise_floor_dbfs\" : " << modes::SignalStats::to_dbfs(summary.p10) << "," << std::endl
+                 << "    \"strong_fraction\"  : " << summary.strong_fraction << "," << std::endl
+                 << "    \"by_type\"          : {";
+            bool first = true;
+            for (std::size_t row = 0; row < summary.rows.size(); ++row) {
+                const auto &r = summary.rows[row];
+                if (!r.messages)
+                    continue;
+                outf << (first ? "" : ",") << std::endl
+                     << "      \"" << (row == modes::SignalStats::modeac_row ? std::string("modeac") : std::string("df") + std::to_string(row)) << "\" : "
+                     << "{ \"messages\" : " << r.messages
+                     << ", \"mean\" : " << r.mean
+                     << ", \"p10\" : " << r.p10 << " }";
+                first = false;
+            }
+            outf << std::endl
+                 << "    }" << std::endl
+                 << "  }," << std::endl;
+        }
+
+        if (clock) {
+            auto summary = clock->summarize();
+
+            std::string clock_color = "green";
+            std::string clock_message = "Receiver timestamps look OK";
+            if (summary.timestamp_type == modes::TimestampType::UNKNOWN) {
+                clock_color = "red";
+                clock_message = "No timestamped messages received";
+            } else if (summary.interval_regressions || summary.interval_jumps) {
+                clock_color = "amber";
+                clock_message = "Receiver timestamps went backwards or jumped";
+            }
+
+            outf << "  \"clock\"    : {" << std::endl
+                 << "    \"status\"      : \"" << clock_color << "\"," << std::endl
+                 << "    \"message\"     : \"" << clock_message << "\"," << std::endl
+                 << "    \"timestamps\"  : \"" << (summary.timestamp_type == modes::TimestampType::GPS ? "gps" :
+                                                    summary.timestamp_type == modes::TimestampType::TWELVEMEG ? "12mhz" : "unknown") << "\"," << std::endl
+                 << "    \"regressions\" : " << summary.regressions << "," << std::endl
+                 << "    \"jumps\"       : " << summary.jumps << "," << std::endl
+                 << "    \"rollovers\"   : " << summary.rollovers;
+            if (summary.drift_valid) {
+                outf << "," << std::endl
+                     << "    \"drift_ppm\"   : " << summary.drift_ppm << "," << std::endl
+                     << "    \"baseline\"    : " << summary.baseline.count();
+            }
+            outf << std::endl
+                 << "  }," << std::endl;
+        }
+
+        if (scheduling) {
+            std::string sched_color = "green";
+            std::string sched_message = "Scheduling options applied";
+            if (!scheduling->errors.empty()) {
+                sched_color = "amber";
+                sched_message.clear();
+                for (const auto &e : scheduling->errors)
+                    sched_message += (sched_message.empty() ? "" : "; ") + e;
+            }
+
+            outf << "  \"scheduling\" : {" << std::endl
+                 << "    \"status\"            : \"" << sched_color << "\"," << std::endl
+                 << "    \"message\"           : \"" << sched_message << "\"," << std::endl
+                 << "    \"cpu\"               : " << scheduling->cpu << "," << std::endl
+                 << "    \"realtime_priority\" : " << scheduling->realtime_priority << "," << std::endl
+                 << "    \"nice\"              : " << scheduling->nice << "," << std::endl
+                 << "    \"memory_locked\"     : " << (scheduling->memory_locked ? "true" : "false") << std::endl
+                 << "  }," << std::endl;
+        }
+
         if (!gps_color.empty()) {
             outf << "  \"gps\"      : {" << std::endl
                  << "    \"status\"  : \"" << gps_color << "\"," << std::endl
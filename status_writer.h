@@ -33,7 +33,11 @@
 
 #include "modes_message.h"
 #include "modes_filter.h"
+#include "modes_aircraft.h"
+#include "modes_signal_stats.h"
+#include "modes_clock_monitor.h"
 #include "beast_input.h"
+#include "scheduling.h"
 
 namespace splitter {
     class StatusWriter : public std::enable_shared_from_this<StatusWriter> {
@@ -46,9 +50,13 @@ namespace splitter {
         static pointer create(boost::asio::io_service &service,
                               modes::FilterDistributor &distributor,
                               beast::BeastInput::pointer input,
-                              const std::string &path)
+                              const std::string &path,
+                              std::shared_ptr<modes::AircraftTable> aircraft = nullptr,
+                              std::shared_ptr<modes::SignalStats> signal = nullptr,
+                              std::shared_ptr<modes::ClockMonitor> clock = nullptr,
+                              std::shared_ptr<const SchedulingStatus> scheduling = nullptr)
         {
-            return pointer(new StatusWriter(service, distributor, input, path));
+            return pointer(new StatusWriter(service, distributor, input, path, aircraft, signal, clock, scheduling));
         }
 
         void start();
@@ -58,7 +66,11 @@ namespace splitter {
         StatusWriter(boost::asio::io_service &service_,
                      modes::FilterDistributor &distributor_,
                      beast::BeastInput::pointer input_,
-                     const std::string &path);
+                     const std::string &path,
+                     std::shared_ptr<modes::AircraftTable> aircraft_,
+                     std::shared_ptr<modes::SignalStats> signal_,
+                     std::shared_ptr<modes::ClockMonitor> clock_,
+                     std::shared_ptr<const SchedulingStatus> scheduling_);
 
         void write(const modes::Message &message);
         void reset_timeout();
@@ -70,6 +82,10 @@ namespace splitter {
         modes::FilterDistributor &distributor;
         beast::BeastInput::pointer input;
         std::string path;
+        std::shared_ptr<modes::AircraftTable> aircraft;
+        std::shared_ptr<modes::SignalStats> signal;
+        std::shared_ptr<modes::ClockMonitor> clock;
+        std::shared_ptr<const SchedulingStatus> scheduling;
 
         std::string temppath;
         modes::FilterDistributor::handle filter_handle;
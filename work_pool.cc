@@ -0,0 +1,137 @@
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+
+#include "work_pool.h"
+
+namespace helpers {
+    // the pool and queue index of the current thread, if it is a worker
+    static thread_local const WorkPool *current_pool = nullptr;
+    static thread_local std::size_t current_index = 0;
+
+    WorkPool::WorkPool(unsigned threads)
+        : queued(0),
+          stopping(false),
+          next_queue(0)
+    {
+        for (unsigned i = 0; i < threads; ++i)
+            workers.emplace_back(new Worker());
+
+        // start threads only once every queue exists, as they steal from each other
+        for (std::size_t i = 0; i < workers.size(); ++i)
+            workers[i]->thread = std::thread(&WorkPool::run, this, i);
+    }
+
+    WorkPool::~WorkPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        // any tasks still queued are discarded
+        for (auto &w : workers)
+            w->thread.join();
+    }
+
+    void WorkPool::submit(Task task)
+    {
+        std::size_t index;
+        if (current_pool == this) {
+            index = current_index;
+        } else {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            index = next_queue;
+            next_queue = (next_queue + 1) % workers.size();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+
+        // count the task only once it is visible in a queue, so a worker
+        // that claims it is sure to find it
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            ++queued;
+        }
+        wake.notify_one();
+    }
+
+    bool WorkPool::take(std::size_t index, Task &task)
+    {
+        {
+            Worker &own = *workers[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (std::size_t i = 1; i < workers.size(); ++i) {
+            Worker &victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WorkPool::run(std::size_t index)
+    {
+        current_pool = this;
+        current_index = index;
+
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake.wait(lock, [this] { return stopping || queued > 0; });
+                if (stopping)
+                    return;
+                --queued;
+            }
+
+            // we claimed one task, so there is at least one to find
+            Task task;
+            while (!take(index, task))
+                std::this_thread::yield();
+
+            try {
+                task();
+            } catch (const std::exception &e) {
+                std::cerr << "work pool task failed: " << e.what() << std::endl;
+            }
+        }
+    }
+};
@@ -0,0 +1,87 @@
+// -*- c++ -*-
+
+// Copyright (c) 2015-2016, FlightAware LLC.
+// Copyright (c) 2015, Oliver Jowett <oliver@mutability.co.uk>
+// All rights reserved.
+
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace helpers {
+    // A small work-stealing thread pool.
+    //
+    // Each worker has its own queue. Tasks submitted from outside the pool
+    // are spread round-robin over the queues; tasks submitted by a worker go
+    // on its own queue. A worker runs its own tasks newest first and, when
+    // its queue is empty, steals the oldest task from another worker.
+    //
+    // Tasks must not block. Results go back to the submitter by whatever
+    // means the task chooses, typically io_service::post.
+    class WorkPool {
+    public:
+        typedef std::function<void()> Task;
+
+        explicit WorkPool(unsigned threads);
+        ~WorkPool();
+
+        WorkPool(const WorkPool &) = delete;
+        WorkPool &operator=(const WorkPool &) = delete;
+
+        void submit(Task task);
+
+        std::size_t size() const {
+            return workers.size();
+        }
+
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            std::thread thread;
+        };
+
+        void run(std::size_t index);
+        bool take(std::size_t index, Task &task);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        // 'queued' counts tasks not yet claimed by a worker
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+        std::size_t queued;
+        bool stopping;
+
+        std::size_t next_queue;
+    };
+};
+
+#endif